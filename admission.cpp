@@ -0,0 +1,54 @@
+/*
+ * admission.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "admission.h"
+
+#include <algorithm>
+
+namespace http {
+admission::admission(const admission_limits& limits, metrics_shard& stats)
+    : m_limits(limits)
+    , m_stats(stats)
+    , m_rejectHead(head_builder(503)
+                   .add("Retry-After", uint64_t(limits.retryAfter))
+                   .add("Content-Length", "0").str())
+{}
+
+bool admission::admit(uint64_t now) noexcept {
+    if (m_limits.requests && m_requests >= m_limits.requests) {
+        m_stats.shedRequests.add();
+        return false;
+    }
+    if (!m_limits.target || !m_limits.interval)
+        return true;
+
+    const auto delay = now > m_batchStart ? now - m_batchStart : 0;
+    m_stats.queueDelay.record(delay);
+    m_minDelay = std::min(m_minDelay, delay);
+    if (now >= m_intervalEnd) {
+        // The queue stands if it was not drained once during the interval.
+        m_overloaded = m_minDelay > m_limits.target;
+        m_minDelay = UINT64_MAX;
+        m_intervalEnd = now + m_limits.interval;
+    }
+
+    if (delay > (m_overloaded ? m_limits.target : m_limits.interval)) {
+        m_stats.shedDelay.add();
+        return false;
+    }
+    return true;
+}
+
+response admission::reject() const {
+    response result;
+    result.status = 503;
+    result.head = {m_rejectHead.data(), m_rejectHead.size()};
+    // Closing the connection sheds its next requests as well.
+    result.keepAlive = false;
+    return result;
+}
+} // namespace http
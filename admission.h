@@ -0,0 +1,131 @@
+/*
+ * admission.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "metrics.h"
+#include "response.h"
+
+namespace http {
+/**
+ * @brief Overload limits of one worker. Times are in nanoseconds.
+ * Zero disables a limit.
+ */
+struct admission_limits {
+    /// Open client connections. Accepting pauses at the limit.
+    size_t connections = 0;
+    /// Requests which replies are not completely sent. Requests above the
+    /// limit are shed and accepting pauses.
+    size_t requests = 0;
+    /// Queue delay the loop tries to stay under.
+    uint64_t target = 0;
+    /// Time the queue delay may stay above the target before requests are
+    /// shed. It is the longest delay of a served request as well.
+    uint64_t interval = 0;
+    /// Seconds a client is asked to wait in Retry-After of a 503 reply.
+    unsigned retryAfter = 1;
+};
+
+/**
+ * @brief Admission control of one event loop.
+ * It counts open connections and requests in flight and decides if a
+ * parsed request is served or answered with 503 at once.
+ * Queue delay of a request is the time since the loop got the batch of
+ * events it came with, so it grows when the loop can't keep up. Like in
+ * CoDel, a short burst is absorbed: while the minimum delay during the last
+ * interval stays under the target, only requests which waited longer than
+ * the interval are shed. When even the minimum delay exceeds the target,
+ * the queue is standing and every request waiting longer than the target
+ * is shed, so the rest are served quickly instead of everybody waiting.
+ * It is used by the loop thread only.
+ */
+class admission {
+    public:
+        admission(const admission_limits& limits, metrics_shard& stats);
+
+        admission(const admission&) = delete;
+        admission& operator=(const admission&) = delete;
+
+        /**
+         * @brief Check if a new connection may be accepted.
+         */
+        bool canAccept() const noexcept {
+            return (!m_limits.connections
+                    || m_connections < m_limits.connections)
+                && (!m_limits.requests || m_requests < m_limits.requests);
+        }
+
+        void opened() noexcept {
+            ++m_connections;
+        }
+
+        void closed() noexcept {
+            --m_connections;
+        }
+
+        size_t connections() const noexcept {
+            return m_connections;
+        }
+
+        /**
+         * @brief Count requests which replies are queued.
+         */
+        void started(size_t count = 1) noexcept {
+            m_requests += count;
+        }
+
+        /**
+         * @brief Count requests which replies are sent or dropped.
+         */
+        void finished(size_t count = 1) noexcept {
+            m_requests -= count;
+        }
+
+        /**
+         * @brief Note the moment the loop got a batch of events.
+         */
+        void batchStarted(uint64_t now) noexcept {
+            m_batchStart = now;
+        }
+
+        /**
+         * @brief Decide if a parsed request is served.
+         * Shed requests are counted in metrics.
+         *
+         * @param now - Current time.
+         *
+         * @return false if the request should get reject().
+         */
+        bool admit(uint64_t now) noexcept;
+
+        /**
+         * @brief Prepare a 503 reply which closes the connection.
+         */
+        response reject() const;
+
+    private:
+        const admission_limits m_limits;
+        metrics_shard& m_stats;
+        /// Head of 503 reply, it is the same for every shed request.
+        const std::string m_rejectHead;
+        size_t m_connections = 0;
+        size_t m_requests = 0;
+        uint64_t m_batchStart = 0;
+        /// End of the current interval and the minimum delay during it.
+        uint64_t m_intervalEnd = 0;
+        uint64_t m_minDelay = UINT64_MAX;
+        /// The minimum delay of the last interval exceeded the target.
+        bool m_overloaded = false;
+};
+} // namespace http
+
+#endif /* !ADMISSION_H */
@@ -0,0 +1,94 @@
+/*
+ * arena.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "arena.h"
+
+namespace http {
+constexpr size_t arena::ALIGNMENT;
+constexpr size_t arena::HEADER_SIZE;
+
+arena::arena(buffer_pool& buffers) noexcept
+    : m_buffers(buffers)
+{}
+
+arena::~arena() {
+    reset();
+}
+
+char* arena::allocate(size_t size) {
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (size > buffer_pool::BUFFER_SIZE - HEADER_SIZE) {
+        const auto b = reinterpret_cast<block*>(new char[HEADER_SIZE + size]);
+        append(b, HEADER_SIZE + size);
+        return reinterpret_cast<char*>(b) + HEADER_SIZE;
+    }
+
+    if (!m_current || m_used + size > buffer_pool::BUFFER_SIZE) {
+        m_current = reinterpret_cast<block*>(m_buffers.acquire());
+        append(m_current, buffer_pool::BUFFER_SIZE);
+        m_used = HEADER_SIZE;
+    }
+    const auto result = reinterpret_cast<char*>(m_current) + m_used;
+    m_used += size;
+    return result;
+}
+
+arena::mark arena::position() const noexcept {
+    return {m_current ? m_current->serial : 0, m_serial + 1};
+}
+
+void arena::release(const mark& position) noexcept {
+    block* kept = nullptr;
+    auto link = &m_first;
+    while (*link && (*link)->serial < position.next) {
+        const auto b = *link;
+        if (b->serial == position.current) {
+            kept = b;
+            link = &b->next;
+            continue;
+        }
+        *link = b->next;
+        if (b == m_last)
+            m_last = kept;
+        if (b == m_current) {
+            m_current = nullptr;
+            m_used = 0;
+        }
+        free(b);
+    }
+}
+
+void arena::reset() noexcept {
+    while (m_first) {
+        const auto next = m_first->next;
+        free(m_first);
+        m_first = next;
+    }
+    m_last = m_current = nullptr;
+    m_used = 0;
+}
+
+void arena::append(block* b, size_t size) noexcept {
+    b->next = nullptr;
+    b->serial = ++m_serial;
+    b->size = size;
+    if (m_last)
+        m_last->next = b;
+    else
+        m_first = b;
+    m_last = b;
+    m_size += size;
+}
+
+void arena::free(block* b) noexcept {
+    m_size -= b->size;
+    if (b->size == buffer_pool::BUFFER_SIZE)
+        m_buffers.release(reinterpret_cast<char*>(b));
+    else
+        delete[] reinterpret_cast<char*>(b);
+}
+} // namespace http
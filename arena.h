@@ -0,0 +1,119 @@
+/*
+ * arena.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "buffer_pool.h"
+
+namespace http {
+/**
+ * @brief Read-only memory which is owned by someone else.
+ */
+struct const_buffer {
+    const char* data;
+    size_t size;
+};
+
+/**
+ * @brief Bump allocator for data which is freed in the order it was
+ * allocated, e.g. heads of replies queued by a connection.
+ * Memory is taken in blocks from a buffer_pool. Blocks are kept in
+ * allocation order, so release() frees blocks of allocations made before a
+ * position() and reset() frees everything at once. Allocations larger than
+ * a pool buffer get their own block from the heap.
+ */
+class arena {
+    public:
+        /**
+         * @brief Construct an empty arena.
+         *
+         * @param buffers - Source of blocks. It must outlive the arena.
+         */
+        explicit arena(buffer_pool& buffers) noexcept;
+        ~arena();
+
+        arena(const arena&) = delete;
+        arena& operator=(const arena&) = delete;
+
+        /**
+         * @brief Place of the next allocation in the arena.
+         */
+        struct mark {
+            /// Block the next allocation may share with earlier ones or 0.
+            uint64_t current;
+            /// Serial number of the next new block.
+            uint64_t next;
+        };
+
+        /**
+         * @brief Allocate memory aligned for any fundamental type.
+         */
+        char* allocate(size_t size);
+
+        /**
+         * @brief Get the place of the next allocation.
+         */
+        mark position() const noexcept;
+
+        /**
+         * @brief Free blocks which hold only allocations made before a
+         * position. A block shared with later allocations is kept.
+         */
+        void release(const mark& position) noexcept;
+
+        /**
+         * @brief Free all allocations and return blocks to the pool.
+         */
+        void reset() noexcept;
+
+        bool empty() const noexcept {
+            return !m_first;
+        }
+
+        /**
+         * @brief Count of bytes in blocks held by the arena.
+         */
+        size_t size() const noexcept {
+            return m_size;
+        }
+
+    private:
+        /// Blocks are linked through their first bytes.
+        struct block {
+            block* next;
+            uint64_t serial;
+            /// Block size, larger than a pool buffer for heap blocks.
+            size_t size;
+        };
+
+        static constexpr size_t ALIGNMENT = alignof(std::max_align_t);
+        static constexpr size_t HEADER_SIZE = (sizeof(block) + ALIGNMENT - 1)
+                                            / ALIGNMENT * ALIGNMENT;
+
+        void append(block* b, size_t size) noexcept;
+        void free(block* b) noexcept;
+
+    private:
+        buffer_pool& m_buffers;
+        /// Pool and heap blocks, the oldest one first.
+        block* m_first = nullptr;
+        block* m_last = nullptr;
+        /// Pool block allocations are taken from.
+        block* m_current = nullptr;
+        /// Bytes used in the current block.
+        size_t m_used = 0;
+        /// Serial number of the last block.
+        uint64_t m_serial = 0;
+        size_t m_size = 0;
+};
+} // namespace http
+
+#endif /* !ARENA_H */
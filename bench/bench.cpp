@@ -0,0 +1,227 @@
+/*
+ * bench.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+/*
+ * Microbenchmarks of the request parsing and reply serialization stages.
+ * Every measurement is printed as one JSON object per line, so results of
+ * two commits may be compared with any line-oriented tool.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "bench/corpus.h"
+#include "boost_parser/request.hpp"
+#include "boost_parser/request_parser.hpp"
+#include "boost_parser/request_view.hpp"
+#include "boost_parser/scanner.hpp"
+#include "common.h"
+#include "request_handler.h"
+#include "response.h"
+
+namespace {
+size_t allocations = 0;
+}
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+namespace {
+const char* resultName(http::request_parser::result_type result) {
+    switch (result) {
+        case http::request_parser::good: return "good";
+        case http::request_parser::bad: return "bad";
+        default: return "indeterminate";
+    }
+}
+
+/**
+ * @brief Run a stage until it takes at least minTime and print the result.
+ *
+ * @tparam Func - Function type. It returns count of processed bytes.
+ * @param stage - Stage name.
+ * @param corpus - Corpus entry name.
+ * @param result - Stage result which is printed as is.
+ * @param minTime - Minimal measurement time in seconds.
+ * @param func - Stage function.
+ */
+template <typename Func>
+void measure(const std::string& stage, const std::string& corpus
+           , const char* result, double minTime, const Func& func) {
+    using clock = std::chrono::steady_clock;
+    size_t bytes = 0;
+    func();
+
+    size_t iterations = 1;
+    while (true) {
+        const auto allocationsBefore = allocations;
+        bytes = 0;
+        const auto start = clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+            bytes += func();
+        const std::chrono::duration<double> elapsed = clock::now() - start;
+        if (elapsed.count() >= minTime) {
+            const auto seconds = elapsed.count();
+            printf("{\"stage\":\"%s\",\"corpus\":\"%s\",\"result\":\"%s\""
+                   ",\"iterations\":%zu,\"ns_per_op\":%.1f"
+                   ",\"bytes_per_sec\":%.0f,\"allocs_per_op\":%.2f}\n"
+                 , stage.c_str(), corpus.c_str(), result, iterations
+                 , seconds * 1e9 / iterations, bytes / seconds
+                 , static_cast<double>(allocations - allocationsBefore)
+                   / iterations);
+            fflush(stdout);
+            return;
+        }
+        iterations *= 2;
+    }
+}
+
+void benchParsers(const corpus_entry& entry, double minTime) {
+    const auto begin = entry.request.data();
+    const auto end = begin + entry.request.size();
+
+    struct variant {
+        const char* stage;
+        http::scanner::isa isa;
+    };
+    const variant variants[] = {
+        {"parse_reference", http::scanner::none},
+        {"parse_scalar", http::scanner::scalar},
+        {"parse_sse42", http::scanner::sse42},
+        {"parse_avx2", http::scanner::avx2},
+    };
+
+    for (const auto& v: variants) {
+        if (!http::scanner::use_isa(v.isa))
+            continue;
+
+        http::request_parser parser;
+        http::request request;
+        const auto parseString = [&] {
+            parser.reset();
+            request = http::request();
+            const auto result = parser.parse(request, begin, end);
+            return static_cast<size_t>(std::get<1>(result) - begin);
+        };
+        measure(std::string(v.stage) + "_string", entry.name
+              , resultName(std::get<0>(parser.parse(request, begin, end)))
+              , minTime, parseString);
+
+        http::request_view view;
+        const auto parseView = [&] {
+            parser.reset();
+            view.clear();
+            const auto result = parser.parse(view, begin, end);
+            return static_cast<size_t>(std::get<1>(result) - begin);
+        };
+        parser.reset();
+        measure(std::string(v.stage) + "_view", entry.name
+              , resultName(std::get<0>(parser.parse(view, begin, end)))
+              , minTime, parseView);
+    }
+    http::scanner::use_isa(http::scanner::best_isa());
+}
+
+void benchParseUri(const corpus_entry& entry, double minTime) {
+    http::request_parser parser;
+    http::request_view view;
+    const auto begin = entry.request.data();
+    if (std::get<0>(parser.parse(view, begin, begin + entry.request.size()))
+            != http::request_parser::good)
+        return;
+
+    view.base = begin;
+    std::string path;
+    const auto parse = [&] {
+        path = "./";
+        http::parseUri(view.data(view.uri), view.uri.length, path);
+        return view.uri.length;
+    };
+    path = "./";
+    const auto valid = http::parseUri(view.data(view.uri), view.uri.length
+                                    , path);
+    measure("parse_uri", entry.name, valid ? "good" : "bad", minTime, parse);
+}
+
+void benchSerialization(double minTime) {
+    http::buffer_pool buffers(1);
+    http::arena memory(buffers);
+    const auto validators = http::validatorHeaders(
+            "\"1a2b-3039-5a0b3c4d\"", "Sun, 06 Nov 1994 08:49:37 GMT");
+    const auto head = [&memory, &validators] {
+        memory.reset();
+        return http::head_builder(200).add("Content-Length", 12345)
+            .add("Content-Type", "text/html").text(validators)
+            .text("Accept-Ranges: bytes\r\n").finish(memory).size;
+    };
+    measure("serialize_head", "-", "good", minTime, head);
+
+    const auto notFound = [] {
+        return http::makeNotFound().memorySize();
+    };
+    measure("serialize_not_found", "-", "good", minTime, notFound);
+}
+}
+
+int main(int argc, char **argv) {
+    static const std::string optstring("c:t:f:");
+
+    std::string corpusPath = BENCH_CORPUS;
+    double minTime = 0.2;
+    std::string filter;
+    int c{0};
+    while ( (c = getopt(argc, argv, optstring.c_str())) != -1) {
+        switch (c) {
+            case 'c':
+                corpusPath = optarg;
+                break;
+            case 't':
+                minTime = getFromStr<double>(optarg);
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            default:
+                std::cerr << "Usage: " << argv[0]
+                          << " [-c <corpus.jsonl>] [-t <seconds>]"
+                          << " [-f <corpus name filter>]" << std::endl;
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    const auto corpus = readCorpus(corpusPath);
+    if (corpus.empty())
+        exit(EXIT_FAILURE);
+
+    for (const auto& entry: corpus) {
+        if (entry.name.find(filter) == std::string::npos)
+            continue;
+        benchParsers(entry, minTime);
+        benchParseUri(entry, minTime);
+    }
+    benchSerialization(minTime);
+    return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * corpus.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "corpus.h"
+
+#include <fstream>
+#include <iostream>
+
+bool readJsonString(const std::string& line, const std::string& key
+                  , std::string& result) {
+    auto pos = line.find('"' + key + '"');
+    if (pos == std::string::npos)
+        return false;
+    pos = line.find(':', pos + key.size() + 2);
+    if (pos == std::string::npos)
+        return false;
+    pos = line.find('"', pos);
+    if (pos == std::string::npos)
+        return false;
+
+    result.clear();
+    for (++pos; pos < line.size(); ++pos) {
+        const auto ch = line[pos];
+        if (ch == '"')
+            return true;
+        if (ch != '\\') {
+            result += ch;
+            continue;
+        }
+        if (++pos == line.size())
+            return false;
+        switch (line[pos]) {
+            case 'n': result += '\n'; break;
+            case 'r': result += '\r'; break;
+            case 't': result += '\t'; break;
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
+            case 'u':
+                if (pos + 4 >= line.size())
+                    return false;
+                // Corpus requests are bytes, so only \u00XX is expected.
+                result += static_cast<char>(
+                        std::stoi(line.substr(pos + 1, 4), nullptr, 16));
+                pos += 4;
+                break;
+            default: result += line[pos]; break;
+        }
+    }
+    return false;
+}
+
+std::vector<corpus_entry> readCorpus(const std::string& path) {
+    std::vector<corpus_entry> corpus;
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Can't open corpus: " << path << std::endl;
+        return corpus;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        corpus_entry entry;
+        if (readJsonString(line, "request", entry.request)) {
+            if (!readJsonString(line, "name", entry.name))
+                entry.name = "entry" + std::to_string(corpus.size());
+            corpus.push_back(std::move(entry));
+        }
+    }
+    return corpus;
+}
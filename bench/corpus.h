@@ -0,0 +1,42 @@
+/*
+ * corpus.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef BENCH_CORPUS_H
+#define BENCH_CORPUS_H
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Request of a corpus shared by bench and fuzz_parser.
+ */
+struct corpus_entry {
+    std::string name;
+    std::string request;
+};
+
+/**
+ * @brief Read a string value of a key from a flat JSON object.
+ *
+ * @param line - JSON object.
+ * @param key - Key.
+ * @param result - Unescaped value.
+ *
+ * @return false if the key is not found or the value is not a string.
+ */
+bool readJsonString(const std::string& line, const std::string& key
+                  , std::string& result);
+
+/**
+ * @brief Read a corpus with one JSON object per line, which has "request"
+ * and optional "name" fields.
+ *
+ * @return Requests or an empty vector if the file can't be read.
+ */
+std::vector<corpus_entry> readCorpus(const std::string& path);
+
+#endif /* !BENCH_CORPUS_H */
@@ -0,0 +1,84 @@
+//
+// char_class.hpp
+// ~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_CHAR_CLASS_HPP
+#define HTTP_CHAR_CLASS_HPP
+
+namespace http {
+namespace char_class {
+
+/// Classes of a byte. Every class is a bit, so a parser state checks the
+/// byte it expects with one table load and one mask.
+enum bits
+{
+  /// Continues a URI: anything but a space or a control character.
+  uri = 1,
+  /// Continues a method or a header name: a non-control ASCII character
+  /// which is not a tspecial.
+  token = 2,
+  /// Continues a header value: anything but a control character.
+  value = 4,
+  /// Decimal digit.
+  digit = 8
+};
+
+constexpr bool is_ctl(int c)
+{
+  return (c >= 0 && c <= 31) || c == 127;
+}
+
+constexpr bool is_tspecial(int c)
+{
+  return c == '(' || c == ')' || c == '<' || c == '>' || c == '@'
+    || c == ',' || c == ';' || c == ':' || c == '\\' || c == '"'
+    || c == '/' || c == '[' || c == ']' || c == '?' || c == '='
+    || c == '{' || c == '}' || c == ' ' || c == '\t';
+}
+
+constexpr unsigned char classify(int c)
+{
+  return static_cast<unsigned char>(
+      (!is_ctl(c) && c != ' ' ? uri : 0)
+    | (c < 128 && !is_ctl(c) && !is_tspecial(c) ? token : 0)
+    | (!is_ctl(c) ? value : 0)
+    | (c >= '0' && c <= '9' ? digit : 0));
+}
+
+#define HTTP_CHAR_CLASS_ROW(n) \
+  classify(n + 0x0), classify(n + 0x1), classify(n + 0x2), \
+  classify(n + 0x3), classify(n + 0x4), classify(n + 0x5), \
+  classify(n + 0x6), classify(n + 0x7), classify(n + 0x8), \
+  classify(n + 0x9), classify(n + 0xa), classify(n + 0xb), \
+  classify(n + 0xc), classify(n + 0xd), classify(n + 0xe), \
+  classify(n + 0xf)
+
+/// Classes of every byte value.
+constexpr unsigned char table[256] =
+{
+  HTTP_CHAR_CLASS_ROW(0x00), HTTP_CHAR_CLASS_ROW(0x10),
+  HTTP_CHAR_CLASS_ROW(0x20), HTTP_CHAR_CLASS_ROW(0x30),
+  HTTP_CHAR_CLASS_ROW(0x40), HTTP_CHAR_CLASS_ROW(0x50),
+  HTTP_CHAR_CLASS_ROW(0x60), HTTP_CHAR_CLASS_ROW(0x70),
+  HTTP_CHAR_CLASS_ROW(0x80), HTTP_CHAR_CLASS_ROW(0x90),
+  HTTP_CHAR_CLASS_ROW(0xa0), HTTP_CHAR_CLASS_ROW(0xb0),
+  HTTP_CHAR_CLASS_ROW(0xc0), HTTP_CHAR_CLASS_ROW(0xd0),
+  HTTP_CHAR_CLASS_ROW(0xe0), HTTP_CHAR_CLASS_ROW(0xf0)
+};
+
+#undef HTTP_CHAR_CLASS_ROW
+
+/// Check if a byte belongs to any of the classes of a mask.
+inline bool is(char c, unsigned mask)
+{
+  return (table[static_cast<unsigned char>(c)] & mask) != 0;
+}
+
+} // namespace char_class
+} // namespace http
+
+#endif // HTTP_CHAR_CLASS_HPP
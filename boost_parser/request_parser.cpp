@@ -9,105 +9,167 @@
 //
 
 #include "request_parser.hpp"
+#include "char_class.hpp"
 #include "request.hpp"
+#include "request_view.hpp"
+#include "scanner.hpp"
 
 namespace http {
 
+namespace {
+
+// Helpers which let one state machine fill both a request and
+// a request_view.
+
+void append(std::string& s, std::size_t, char input)
+{
+  s.push_back(input);
+}
+
+void append(slice& s, std::size_t pos, char input)
+{
+  (void)input;
+  if (s.length == 0)
+    s.offset = pos;
+  // A folded header value spans the line break between its parts.
+  s.length = pos - s.offset + 1;
+}
+
+void append(std::string& s, std::size_t, const char* begin, const char* end)
+{
+  s.append(begin, end);
+}
+
+void append(slice& s, std::size_t pos, const char* begin, const char* end)
+{
+  if (s.length == 0)
+    s.offset = pos;
+  s.length = pos + (end - begin) - s.offset;
+}
+
+bool has_headers(const request& req)
+{
+  return !req.headers.empty();
+}
+
+bool has_headers(const request_view& req)
+{
+  return req.header_count != 0;
+}
+
+bool add_header(request& req)
+{
+  req.headers.push_back(header());
+  return true;
+}
+
+bool add_header(request_view& req)
+{
+  if (req.header_count == request_view::max_headers)
+    return false;
+  req.headers[req.header_count++] = header_view();
+  return true;
+}
+
+header& last_header(request& req)
+{
+  return req.headers.back();
+}
+
+header_view& last_header(request_view& req)
+{
+  return req.headers[req.header_count - 1];
+}
+
+/// Method name known at compile time, so matching it is a few compares
+/// of constants.
+template <char... Chars>
+struct method_literal;
+
+template <>
+struct method_literal<>
+{
+  static constexpr std::size_t size = 0;
+
+  static bool match(const char*)
+  {
+    return true;
+  }
+};
+
+template <char First, char... Rest>
+struct method_literal<First, Rest...>
+{
+  static constexpr std::size_t size = 1 + sizeof...(Rest);
+
+  static bool match(const char* input)
+  {
+    return input[0] == First && method_literal<Rest...>::match(input + 1);
+  }
+};
+
+} // namespace
+
 request_parser::request_parser()
-  : state_(method_start)
+  : state_(method_start),
+    pos_(0)
 {
 }
 
 void request_parser::reset()
 {
   state_ = method_start;
+  pos_ = 0;
 }
 
-request_parser::result_type request_parser::consume(request& req, char input)
+// Every state checks the class of the byte it expects most first, so the
+// common path costs one table load and one branch.
+template <typename Request>
+inline request_parser::result_type request_parser::consume(Request& req,
+    char input)
 {
   switch (state_)
   {
   case method_start:
-    if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
-      return bad;
-    }
-    else
+    if (char_class::is(input, char_class::token))
     {
       state_ = method;
-      req.method.push_back(input);
+      append(req.method, pos_, input);
       return indeterminate;
     }
+    return bad;
   case method:
-    if (input == ' ')
+    if (char_class::is(input, char_class::token))
     {
-      state_ = uri;
+      append(req.method, pos_, input);
       return indeterminate;
     }
-    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
-      return bad;
-    }
-    else
+    else if (input == ' ')
     {
-      req.method.push_back(input);
+      state_ = uri;
       return indeterminate;
     }
+    return bad;
   case uri:
-    if (input == ' ')
+    if (char_class::is(input, char_class::uri))
     {
-      state_ = http_version_h;
+      append(req.uri, pos_, input);
       return indeterminate;
     }
-    else if (is_ctl(input))
-    {
-      return bad;
-    }
-    else
+    else if (input == ' ')
     {
-      req.uri.push_back(input);
+      state_ = http_version_h;
       return indeterminate;
     }
+    return bad;
   case http_version_h:
-    if (input == 'H')
-    {
-      state_ = http_version_t_1;
-      return indeterminate;
-    }
-    else
-    {
-      return bad;
-    }
+    return expect(input, 'H', http_version_t_1);
   case http_version_t_1:
-    if (input == 'T')
-    {
-      state_ = http_version_t_2;
-      return indeterminate;
-    }
-    else
-    {
-      return bad;
-    }
+    return expect(input, 'T', http_version_t_2);
   case http_version_t_2:
-    if (input == 'T')
-    {
-      state_ = http_version_p;
-      return indeterminate;
-    }
-    else
-    {
-      return bad;
-    }
+    return expect(input, 'T', http_version_p);
   case http_version_p:
-    if (input == 'P')
-    {
-      state_ = http_version_slash;
-      return indeterminate;
-    }
-    else
-    {
-      return bad;
-    }
+    return expect(input, 'P', http_version_slash);
   case http_version_slash:
     if (input == '/')
     {
@@ -116,164 +178,89 @@ request_parser::result_type request_parser::consume(request& req, char input)
       state_ = http_version_major_start;
       return indeterminate;
     }
-    else
-    {
-      return bad;
-    }
+    return bad;
   case http_version_major_start:
-    if (is_digit(input))
+    if (char_class::is(input, char_class::digit))
     {
       req.http_version_major = req.http_version_major * 10 + input - '0';
       state_ = http_version_major;
       return indeterminate;
     }
-    else
-    {
-      return bad;
-    }
+    return bad;
   case http_version_major:
-    if (input == '.')
-    {
-      state_ = http_version_minor_start;
-      return indeterminate;
-    }
-    else if (is_digit(input))
+    if (char_class::is(input, char_class::digit))
     {
       req.http_version_major = req.http_version_major * 10 + input - '0';
       return indeterminate;
     }
-    else
-    {
-      return bad;
-    }
+    return expect(input, '.', http_version_minor_start);
   case http_version_minor_start:
-    if (is_digit(input))
+    if (char_class::is(input, char_class::digit))
     {
       req.http_version_minor = req.http_version_minor * 10 + input - '0';
       state_ = http_version_minor;
       return indeterminate;
     }
-    else
-    {
-      return bad;
-    }
+    return bad;
   case http_version_minor:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_1;
-      return indeterminate;
-    }
-    else if (is_digit(input))
+    if (char_class::is(input, char_class::digit))
     {
       req.http_version_minor = req.http_version_minor * 10 + input - '0';
       return indeterminate;
     }
-    else
-    {
-      return bad;
-    }
+    return expect(input, '\r', expecting_newline_1);
   case expecting_newline_1:
-    if (input == '\n')
+    return expect(input, '\n', header_line_start);
+  case header_line_start:
+    if (char_class::is(input, char_class::token))
     {
-      state_ = header_line_start;
+      if (!add_header(req))
+        return bad;
+      append(last_header(req).name, pos_, input);
+      state_ = header_name;
       return indeterminate;
     }
-    else
-    {
-      return bad;
-    }
-  case header_line_start:
-    if (input == '\r')
+    else if (input == '\r')
     {
       state_ = expecting_newline_3;
       return indeterminate;
     }
-    else if (!req.headers.empty() && (input == ' ' || input == '\t'))
+    else if (has_headers(req) && (input == ' ' || input == '\t'))
     {
       state_ = header_lws;
       return indeterminate;
     }
-    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
-      return bad;
-    }
-    else
-    {
-      req.headers.push_back(header());
-      req.headers.back().name.push_back(input);
-      state_ = header_name;
-      return indeterminate;
-    }
+    return bad;
   case header_lws:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_2;
-      return indeterminate;
-    }
-    else if (input == ' ' || input == '\t')
+    if (input == ' ' || input == '\t')
     {
       return indeterminate;
     }
-    else if (is_ctl(input))
-    {
-      return bad;
-    }
-    else
+    else if (char_class::is(input, char_class::value))
     {
       state_ = header_value;
-      req.headers.back().value.push_back(input);
+      append(last_header(req).value, pos_, input);
       return indeterminate;
     }
+    return expect(input, '\r', expecting_newline_2);
   case header_name:
-    if (input == ':')
-    {
-      state_ = space_before_header_value;
-      return indeterminate;
-    }
-    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
-      return bad;
-    }
-    else
+    if (char_class::is(input, char_class::token))
     {
-      req.headers.back().name.push_back(input);
+      append(last_header(req).name, pos_, input);
       return indeterminate;
     }
+    return expect(input, ':', space_before_header_value);
   case space_before_header_value:
-    if (input == ' ')
-    {
-      state_ = header_value;
-      return indeterminate;
-    }
-    else
-    {
-      return bad;
-    }
+    return expect(input, ' ', header_value);
   case header_value:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_2;
-      return indeterminate;
-    }
-    else if (is_ctl(input))
+    if (char_class::is(input, char_class::value))
     {
-      return bad;
-    }
-    else
-    {
-      req.headers.back().value.push_back(input);
+      append(last_header(req).value, pos_, input);
       return indeterminate;
     }
+    return expect(input, '\r', expecting_newline_2);
   case expecting_newline_2:
-    if (input == '\n')
-    {
-      state_ = header_line_start;
-      return indeterminate;
-    }
-    else
-    {
-      return bad;
-    }
+    return expect(input, '\n', header_line_start);
   case expecting_newline_3:
     return (input == '\n') ? good : bad;
   default:
@@ -281,33 +268,97 @@ request_parser::result_type request_parser::consume(request& req, char input)
   }
 }
 
-bool request_parser::is_char(int c)
+request_parser::result_type request_parser::expect(char input, char expected,
+    state next)
 {
-  return c >= 0 && c <= 127;
-}
-
-bool request_parser::is_ctl(int c)
-{
-  return (c >= 0 && c <= 31) || (c == 127);
+  if (input != expected)
+    return bad;
+  state_ = next;
+  return indeterminate;
 }
 
-bool request_parser::is_tspecial(int c)
+template <typename Request>
+const char* request_parser::skip_run(Request& req, const char* begin,
+    const char* end)
 {
-  switch (c)
+  const char* run_end;
+  switch (state_)
   {
-  case '(': case ')': case '<': case '>': case '@':
-  case ',': case ';': case ':': case '\\': case '"':
-  case '/': case '[': case ']': case '?': case '=':
-  case '{': case '}': case ' ': case '\t':
-    return true;
+  case method_start:
+    run_end = skip_method<method_literal<'G', 'E', 'T'> >(req, begin, end);
+    if (run_end == begin)
+      run_end = skip_method<method_literal<'H', 'E', 'A', 'D'> >(req,
+          begin, end);
+    return run_end;
+  case method:
+    run_end = scanner::find_token_end(begin, end);
+    append(req.method, pos_, begin, run_end);
+    break;
+  case uri:
+    run_end = scanner::find_uri_end(begin, end);
+    append(req.uri, pos_, begin, run_end);
+    break;
+  case header_name:
+    run_end = scanner::find_token_end(begin, end);
+    append(last_header(req).name, pos_, begin, run_end);
+    break;
+  case header_value:
+    run_end = scanner::find_value_end(begin, end);
+    append(last_header(req).value, pos_, begin, run_end);
+    break;
   default:
-    return false;
+    return begin;
   }
+  pos_ += run_end - begin;
+  return run_end;
 }
 
-bool request_parser::is_digit(int c)
+template <typename Literal, typename Request>
+const char* request_parser::skip_method(Request& req, const char* begin,
+    const char* end)
 {
-  return c >= '0' && c <= '9';
+  // The method must be followed by a space, otherwise it is a longer token.
+  if (static_cast<std::size_t>(end - begin) <= Literal::size
+      || !Literal::match(begin) || begin[Literal::size] != ' ')
+    return begin;
+  append(req.method, pos_, begin, begin + Literal::size);
+  pos_ += Literal::size + 1;
+  state_ = uri;
+  return begin + Literal::size + 1;
 }
 
+template <typename Request>
+std::tuple<request_parser::result_type, const char*>
+request_parser::parse(Request& req, const char* begin, const char* end)
+{
+  // Without run scanners every byte goes through the state machine, so the
+  // scanners are not even called.
+  const bool runs = scanner::current_isa() != scanner::none;
+  while (begin != end)
+  {
+    if (runs)
+    {
+      begin = skip_run(req, begin, end);
+      if (begin == end)
+        break;
+    }
+    result_type result = consume(req, *begin++);
+    ++pos_;
+    if (result == good || result == bad)
+      return std::make_tuple(result, begin);
+  }
+  return std::make_tuple(indeterminate, begin);
+}
+
+template request_parser::result_type
+request_parser::consume<request>(request& req, char input);
+template request_parser::result_type
+request_parser::consume<request_view>(request_view& req, char input);
+template std::tuple<request_parser::result_type, const char*>
+request_parser::parse<request>(request& req, const char* begin,
+    const char* end);
+template std::tuple<request_parser::result_type, const char*>
+request_parser::parse<request_view>(request_view& req, const char* begin,
+    const char* end);
+
 } // namespace http
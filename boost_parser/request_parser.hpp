@@ -11,13 +11,18 @@
 #ifndef HTTP_REQUEST_PARSER_HPP
 #define HTTP_REQUEST_PARSER_HPP
 
+#include <cstddef>
 #include <tuple>
 
 namespace http {
 
 struct request;
+struct request_view;
 
-/// Parser for incoming requests.
+/// Parser for incoming requests. It either copies parts of a request into
+/// a request, or records their offsets into a request_view. In the latter
+/// mode offsets are counted from the first byte passed after reset(), so the
+/// caller must keep all bytes of a request contiguous.
 class request_parser
 {
 public:
@@ -33,35 +38,51 @@ public:
   /// Parse some data. The enum return value is good when a complete request has
   /// been parsed, bad if the data is invalid, indeterminate when more data is
   /// required. The InputIterator return value indicates how much of the input
-  /// has been consumed.
-  template <typename InputIterator>
-  std::tuple<result_type, InputIterator> parse(request& req,
+  /// has been consumed. Request is either request or request_view.
+  template <typename Request, typename InputIterator>
+  std::tuple<result_type, InputIterator> parse(Request& req,
       InputIterator begin, InputIterator end)
   {
     while (begin != end)
     {
       result_type result = consume(req, *begin++);
+      ++pos_;
       if (result == good || result == bad)
         return std::make_tuple(result, begin);
     }
     return std::make_tuple(indeterminate, begin);
   }
 
-private:
-  /// Handle the next character of input.
-  result_type consume(request& req, char input);
+  /// Parse contiguous data. The state machine is inlined into the loop and
+  /// runs of bytes which can not change the state are skipped in one step.
+  template <typename Request>
+  std::tuple<result_type, const char*> parse(Request& req,
+      const char* begin, const char* end);
 
-  /// Check if a byte is an HTTP character.
-  static bool is_char(int c);
+  template <typename Request>
+  std::tuple<result_type, char*> parse(Request& req, char* begin, char* end)
+  {
+    const std::tuple<result_type, const char*> result = parse(req,
+        static_cast<const char*>(begin), static_cast<const char*>(end));
+    return std::make_tuple(std::get<0>(result),
+        const_cast<char*>(std::get<1>(result)));
+  }
 
-  /// Check if a byte is an HTTP control character.
-  static bool is_ctl(int c);
+private:
+  /// Handle the next character of input.
+  template <typename Request>
+  result_type consume(Request& req, char input);
 
-  /// Check if a byte is defined as an HTTP tspecial character.
-  static bool is_tspecial(int c);
+  /// Consume bytes which can not change the state, such as the middle of
+  /// a URI or a header value, in one step. Returns the first byte which must
+  /// be passed to consume(). Only contiguous input is scanned this way.
+  template <typename Request>
+  const char* skip_run(Request& req, const char* begin, const char* end);
 
-  /// Check if a byte is a digit.
-  static bool is_digit(int c);
+  /// Consume a method with the following space at once if it is Literal.
+  /// Returns begin if the input does not start with it.
+  template <typename Literal, typename Request>
+  const char* skip_method(Request& req, const char* begin, const char* end);
 
   /// The current state of the parser.
   enum state
@@ -87,6 +108,12 @@ private:
     expecting_newline_2,
     expecting_newline_3
   } state_;
+
+  /// Move to the next state if the byte is the expected one.
+  result_type expect(char input, char expected, state next);
+
+  /// Offset of the next input byte from the beginning of the request.
+  std::size_t pos_;
 };
 
 } // namespace http
@@ -0,0 +1,108 @@
+//
+// request_view.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_REQUEST_VIEW_HPP
+#define HTTP_REQUEST_VIEW_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <strings.h>
+
+namespace http {
+
+/// A part of the receive buffer, relative to the first byte of a request.
+struct slice
+{
+  std::size_t offset;
+  std::size_t length;
+};
+
+/// A header which refers to the receive buffer.
+struct header_view
+{
+  slice name;
+  slice value;
+};
+
+/// A request received from a client which refers to the receive buffer
+/// instead of owning copies of its parts. Parsing into it does not allocate.
+struct request_view
+{
+  /// Maximum count of headers, a request with more headers is bad.
+  static constexpr std::size_t max_headers = 64;
+
+  /// First byte of the request. It is set by the owner of the buffer.
+  const char* base;
+  slice method;
+  slice uri;
+  int http_version_major;
+  int http_version_minor;
+  header_view headers[max_headers];
+  std::size_t header_count;
+
+  request_view()
+  {
+    clear();
+  }
+
+  /// Reset to an empty request.
+  void clear()
+  {
+    base = nullptr;
+    method = slice{0, 0};
+    uri = slice{0, 0};
+    http_version_major = 0;
+    http_version_minor = 0;
+    header_count = 0;
+  }
+
+  /// Pointer to the first byte of a slice.
+  const char* data(slice s) const
+  {
+    return base + s.offset;
+  }
+
+  /// Copy a slice into a string.
+  std::string str(slice s) const
+  {
+    return std::string(data(s), s.length);
+  }
+
+  /// Check if a slice is equal to a string.
+  bool equals(slice s, const char* str) const
+  {
+    return s.length == std::strlen(str)
+      && std::memcmp(data(s), str, s.length) == 0;
+  }
+
+  /// Check if a slice is equal to a string ignoring case.
+  bool iequals(slice s, const char* str) const
+  {
+    return s.length == std::strlen(str)
+      && strncasecmp(data(s), str, s.length) == 0;
+  }
+
+  /// Find a header by case-insensitive name. Returns nullptr if not found.
+  const header_view* find_header(const char* name) const
+  {
+    const std::size_t length = std::strlen(name);
+    for (std::size_t i = 0; i < header_count; ++i)
+    {
+      const header_view& h = headers[i];
+      if (h.name.length == length
+          && strncasecmp(data(h.name), name, length) == 0)
+        return &h;
+    }
+    return nullptr;
+  }
+};
+
+} // namespace http
+
+#endif // HTTP_REQUEST_VIEW_HPP
@@ -0,0 +1,305 @@
+//
+// scanner.cpp
+// ~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "scanner.hpp"
+
+#include <cstring>
+
+#include "char_class.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HTTP_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace http {
+namespace scanner {
+
+namespace {
+
+typedef const char* (*scan_function)(const char*, const char*);
+
+struct scanners
+{
+  scan_function uri;
+  scan_function token;
+  scan_function value;
+};
+
+struct class_tables
+{
+  // Token classification by nibbles for pshufb: a byte is a token character
+  // if token_high[c >> 4] & token_low[c & 0xf] is non-zero.
+  alignas(16) unsigned char token_high[16];
+  alignas(16) unsigned char token_low[16];
+
+  class_tables()
+  {
+    std::memset(this, 0, sizeof(*this));
+    for (int c = 0; c < 128; ++c)
+    {
+      if (char_class::table[c] & char_class::token)
+      {
+        // Every high nibble of ASCII has its own bit.
+        token_high[c >> 4] = static_cast<unsigned char>(1 << (c >> 4));
+        token_low[c & 0xf] |= static_cast<unsigned char>(1 << (c >> 4));
+      }
+    }
+  }
+};
+
+const class_tables& tables()
+{
+  static const class_tables instance;
+  return instance;
+}
+
+template <unsigned char Bit>
+const char* scalar_scan(const char* begin, const char* end)
+{
+  while (begin != end && char_class::is(*begin, Bit))
+    ++begin;
+  return begin;
+}
+
+const char* none_scan(const char* begin, const char*)
+{
+  return begin;
+}
+
+#ifdef HTTP_SCANNER_X86
+
+// Bytes 0x00-0x20 and 0x7f end a URI, 0x00-0x1f and 0x7f end a value.
+__attribute__((target("sse4.2")))
+const char* sse42_ranges_scan(const char* begin, const char* end,
+    const __m128i ranges)
+{
+  while (end - begin >= 16)
+  {
+    const __m128i data = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(begin));
+    const int index = _mm_cmpestri(ranges, 4, data, 16,
+        _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+    if (index != 16)
+      return begin + index;
+    begin += 16;
+  }
+  return begin;
+}
+
+__attribute__((target("sse4.2")))
+const char* sse42_uri_scan(const char* begin, const char* end)
+{
+  const __m128i ranges = _mm_setr_epi8(0x00, 0x20, 0x7f, 0x7f,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  begin = sse42_ranges_scan(begin, end, ranges);
+  return scalar_scan<char_class::uri>(begin, end);
+}
+
+__attribute__((target("sse4.2")))
+const char* sse42_value_scan(const char* begin, const char* end)
+{
+  const __m128i ranges = _mm_setr_epi8(0x00, 0x1f, 0x7f, 0x7f,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  begin = sse42_ranges_scan(begin, end, ranges);
+  return scalar_scan<char_class::value>(begin, end);
+}
+
+__attribute__((target("sse4.2")))
+const char* sse42_token_scan(const char* begin, const char* end)
+{
+  const class_tables& t = tables();
+  const __m128i high_table = _mm_load_si128(
+      reinterpret_cast<const __m128i*>(t.token_high));
+  const __m128i low_table = _mm_load_si128(
+      reinterpret_cast<const __m128i*>(t.token_low));
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  while (end - begin >= 16)
+  {
+    const __m128i data = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(begin));
+    const __m128i high = _mm_shuffle_epi8(high_table,
+        _mm_and_si128(_mm_srli_epi16(data, 4), nibble));
+    const __m128i low = _mm_shuffle_epi8(low_table,
+        _mm_and_si128(data, nibble));
+    const __m128i stop = _mm_cmpeq_epi8(_mm_and_si128(high, low),
+        _mm_setzero_si128());
+    const int mask = _mm_movemask_epi8(stop);
+    if (mask != 0)
+      return begin + __builtin_ctz(mask);
+    begin += 16;
+  }
+  return scalar_scan<char_class::token>(begin, end);
+}
+
+// Mask of bytes which are less or equal to limit, or equal to 0x7f.
+__attribute__((target("avx2")))
+unsigned avx2_ctl_mask(const __m256i data, const __m256i limit)
+{
+  const __m256i low = _mm256_cmpeq_epi8(_mm256_min_epu8(data, limit), data);
+  const __m256i del = _mm256_cmpeq_epi8(data, _mm256_set1_epi8(0x7f));
+  return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(low, del)));
+}
+
+__attribute__((target("avx2")))
+const char* avx2_uri_scan(const char* begin, const char* end)
+{
+  const __m256i limit = _mm256_set1_epi8(0x20);
+  while (end - begin >= 32)
+  {
+    const __m256i data = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(begin));
+    const unsigned mask = avx2_ctl_mask(data, limit);
+    if (mask != 0)
+      return begin + __builtin_ctz(mask);
+    begin += 32;
+  }
+  return scalar_scan<char_class::uri>(begin, end);
+}
+
+__attribute__((target("avx2")))
+const char* avx2_value_scan(const char* begin, const char* end)
+{
+  const __m256i limit = _mm256_set1_epi8(0x1f);
+  while (end - begin >= 32)
+  {
+    const __m256i data = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(begin));
+    const unsigned mask = avx2_ctl_mask(data, limit);
+    if (mask != 0)
+      return begin + __builtin_ctz(mask);
+    begin += 32;
+  }
+  return scalar_scan<char_class::value>(begin, end);
+}
+
+__attribute__((target("avx2")))
+const char* avx2_token_scan(const char* begin, const char* end)
+{
+  const class_tables& t = tables();
+  const __m256i high_table = _mm256_broadcastsi128_si256(_mm_load_si128(
+      reinterpret_cast<const __m128i*>(t.token_high)));
+  const __m256i low_table = _mm256_broadcastsi128_si256(_mm_load_si128(
+      reinterpret_cast<const __m128i*>(t.token_low)));
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  while (end - begin >= 32)
+  {
+    const __m256i data = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(begin));
+    const __m256i high = _mm256_shuffle_epi8(high_table,
+        _mm256_and_si256(_mm256_srli_epi16(data, 4), nibble));
+    const __m256i low = _mm256_shuffle_epi8(low_table,
+        _mm256_and_si256(data, nibble));
+    const __m256i stop = _mm256_cmpeq_epi8(_mm256_and_si256(high, low),
+        _mm256_setzero_si256());
+    const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(stop));
+    if (mask != 0)
+      return begin + __builtin_ctz(mask);
+    begin += 32;
+  }
+  return sse42_token_scan(begin, end);
+}
+
+#endif // HTTP_SCANNER_X86
+
+bool supported(isa value)
+{
+  switch (value)
+  {
+  case none:
+  case scalar:
+    return true;
+#ifdef HTTP_SCANNER_X86
+  case sse42:
+    return __builtin_cpu_supports("sse4.2");
+  case avx2:
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.2");
+#endif
+  default:
+    return false;
+  }
+}
+
+scanners make_scanners(isa value)
+{
+  switch (value)
+  {
+  case none:
+    return scanners{ none_scan, none_scan, none_scan };
+#ifdef HTTP_SCANNER_X86
+  case sse42:
+    return scanners{ sse42_uri_scan, sse42_token_scan, sse42_value_scan };
+  case avx2:
+    return scanners{ avx2_uri_scan, avx2_token_scan, avx2_value_scan };
+#endif
+  default:
+    return scanners{ scalar_scan<char_class::uri>, scalar_scan<char_class::token>,
+      scalar_scan<char_class::value> };
+  }
+}
+
+struct state
+{
+  isa current;
+  scanners functions;
+
+  state()
+    : current(best_isa()),
+      functions(make_scanners(current))
+  {
+  }
+};
+
+state& active()
+{
+  static state instance;
+  return instance;
+}
+
+} // namespace
+
+isa best_isa()
+{
+  if (supported(avx2))
+    return avx2;
+  if (supported(sse42))
+    return sse42;
+  return scalar;
+}
+
+isa current_isa()
+{
+  return active().current;
+}
+
+bool use_isa(isa value)
+{
+  if (!supported(value))
+    return false;
+  active().current = value;
+  active().functions = make_scanners(value);
+  return true;
+}
+
+const char* find_uri_end(const char* begin, const char* end)
+{
+  return active().functions.uri(begin, end);
+}
+
+const char* find_token_end(const char* begin, const char* end)
+{
+  return active().functions.token(begin, end);
+}
+
+const char* find_value_end(const char* begin, const char* end)
+{
+  return active().functions.value(begin, end);
+}
+
+} // namespace scanner
+} // namespace http
@@ -0,0 +1,53 @@
+//
+// scanner.hpp
+// ~~~~~~~~~~~
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_SCANNER_HPP
+#define HTTP_SCANNER_HPP
+
+namespace http {
+namespace scanner {
+
+/// Implementation of the run scanners used by request_parser.
+enum isa
+{
+  /// No run scanning, the parser handles every byte by its state machine.
+  none,
+  /// Portable byte loop.
+  scalar,
+  /// 16 bytes per step with SSE4.2 string instructions.
+  sse42,
+  /// 32 bytes per step with AVX2.
+  avx2
+};
+
+/// The best implementation supported by the CPU.
+isa best_isa();
+
+/// The implementation in use. It is best_isa() by default.
+isa current_isa();
+
+/// Select an implementation. Returns false if the CPU does not support it.
+/// It is not thread-safe and should be called before parsing starts.
+bool use_isa(isa value);
+
+/// Find the first byte which can not continue a URI: a space or a control
+/// character.
+const char* find_uri_end(const char* begin, const char* end);
+
+/// Find the first byte which can not continue a method or a header name:
+/// anything but a non-control ASCII character which is not a tspecial.
+const char* find_token_end(const char* begin, const char* end);
+
+/// Find the first byte which can not continue a header value: a control
+/// character, including CR.
+const char* find_value_end(const char* begin, const char* end);
+
+} // namespace scanner
+} // namespace http
+
+#endif // HTTP_SCANNER_HPP
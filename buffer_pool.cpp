@@ -0,0 +1,39 @@
+/*
+ * buffer_pool.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "buffer_pool.h"
+
+#include <algorithm>
+
+namespace http {
+constexpr size_t buffer_pool::BUFFER_SIZE;
+
+buffer_pool::buffer_pool(size_t buffersPerSlab)
+    : m_buffersPerSlab(std::max<size_t>(buffersPerSlab, 1))
+{}
+
+char* buffer_pool::acquire() {
+    if (!m_free) {
+        // Buffers of a new slab are linked in address order.
+        m_slabs.reserve(m_slabs.size() + 1);
+        m_slabs.emplace_back(new char[m_buffersPerSlab * BUFFER_SIZE]);
+        const auto slab = m_slabs.back().get();
+        for (size_t i = m_buffersPerSlab; i-- > 0; )
+            release(slab + i * BUFFER_SIZE);
+    }
+
+    const auto buffer = m_free;
+    m_free = buffer->next;
+    return reinterpret_cast<char*>(buffer);
+}
+
+void buffer_pool::release(char* buffer) noexcept {
+    const auto node = reinterpret_cast<free_buffer*>(buffer);
+    node->next = m_free;
+    m_free = node;
+}
+} // namespace http
@@ -0,0 +1,66 @@
+/*
+ * buffer_pool.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace http {
+/**
+ * @brief Pool of fixed-size buffers of one worker thread.
+ * Buffers are carved from slabs allocated on demand and released buffers
+ * are kept in an intrusive free list, so connections hold memory only
+ * while they read or reply and the steady state does not call malloc.
+ * Slabs are freed with the pool. It is not thread-safe.
+ */
+class buffer_pool {
+    public:
+        static constexpr size_t BUFFER_SIZE = 8192;
+
+        /**
+         * @brief Construct an empty pool.
+         *
+         * @param buffersPerSlab - Count of buffers allocated at once.
+         */
+        explicit buffer_pool(size_t buffersPerSlab = 32);
+
+        buffer_pool(const buffer_pool&) = delete;
+        buffer_pool& operator=(const buffer_pool&) = delete;
+
+        /**
+         * @brief Take a buffer of BUFFER_SIZE bytes.
+         */
+        char* acquire();
+
+        /**
+         * @brief Return a buffer taken with acquire().
+         */
+        void release(char* buffer) noexcept;
+
+        /**
+         * @brief Count of bytes allocated for buffers.
+         */
+        size_t capacity() const noexcept {
+            return m_slabs.size() * m_buffersPerSlab * BUFFER_SIZE;
+        }
+
+    private:
+        /// Free buffers are linked through their first bytes.
+        struct free_buffer {
+            free_buffer* next;
+        };
+
+        size_t m_buffersPerSlab;
+        std::vector<std::unique_ptr<char[]>> m_slabs;
+        free_buffer* m_free = nullptr;
+};
+} // namespace http
+
+#endif /* !BUFFER_POOL_H */
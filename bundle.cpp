@@ -0,0 +1,406 @@
+/*
+ * bundle.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "bundle.h"
+
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "compression.h"
+#include "response.h"
+
+namespace {
+constexpr uint64_t BODY_ALIGNMENT = 4096;
+/// Seeds tried for one bucket before packing gives up.
+constexpr uint32_t MAX_SEED = 1u << 24;
+
+uint64_t hashPath(const char* path, size_t size) noexcept {
+    // FNV-1a.
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(path[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t mix(uint64_t x) noexcept {
+    // Finalizer of splitmix64.
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+size_t bucketOf(uint64_t hash, uint32_t bucketCount) noexcept {
+    return mix(hash) % bucketCount;
+}
+
+size_t slotOf(uint64_t hash, uint32_t seed, uint32_t count) noexcept {
+    return mix(hash ^ (seed * 0x9e3779b97f4a7c15ull)) % count;
+}
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) noexcept {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool isInside(const http::bundle_blob& b, uint64_t size) noexcept {
+    return b.offset <= size && b.size <= size - b.offset;
+}
+
+struct packed_variant {
+    bool present = false;
+    std::string etag;
+    std::string head;
+    std::string notModifiedHead;
+    std::string body;
+};
+
+struct packed_file {
+    std::string path;
+    struct stat stat;
+    packed_variant variants[http::bundle_entry::VARIANTS_COUNT];
+};
+
+bool readFile(const std::string& path, std::string& result) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    result.assign(std::istreambuf_iterator<char>(file)
+                , std::istreambuf_iterator<char>());
+    return !file.bad();
+}
+
+/**
+ * @brief Append relative paths of regular files of a directory tree.
+ * Symbolic links are skipped, so there are no cycles.
+ */
+void listFiles(const std::string& rootDir, const std::string& dir
+             , std::vector<std::string>& files) {
+    const auto d = opendir((rootDir + dir).c_str());
+    if (!d)
+        return;
+    while (const auto entry = readdir(d)) {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+        const auto path = dir + name;
+        struct stat fileStat;
+        if (lstat((rootDir + path).c_str(), &fileStat) < 0)
+            continue;
+        if (S_ISDIR(fileStat.st_mode))
+            listFiles(rootDir, path + '/', files);
+        else if (S_ISREG(fileStat.st_mode))
+            files.push_back(path);
+    }
+    closedir(d);
+}
+
+void makeVariant(packed_variant& v, const char* type
+               , http::content_encoding encoding, const std::string& etag
+               , const std::string& lastModified) {
+    v.present = true;
+    v.etag = etag;
+    if (encoding != http::content_encoding::identity)
+        v.etag.insert(v.etag.size() - 1
+                    , std::string("-") + http::encodingName(encoding));
+    const auto validators = http::validatorHeaders(v.etag, lastModified);
+    const auto compressible = http::isCompressible(type);
+
+    http::head_builder head(200);
+    head.add("Content-Length", v.body.size()).add("Content-Type", type);
+    if (encoding != http::content_encoding::identity)
+        head.add("Content-Encoding", http::encodingName(encoding));
+    head.text(validators).text("Accept-Ranges: bytes\r\n");
+    if (compressible)
+        head.text("Vary: Accept-Encoding\r\n");
+    v.head = head.str();
+
+    http::head_builder notModified(304);
+    notModified.text(validators);
+    if (compressible)
+        notModified.text("Vary: Accept-Encoding\r\n");
+    v.notModifiedHead = notModified.str();
+}
+
+bool packFile(const std::string& rootDir, const std::string& path
+            , packed_file& result) {
+    const auto fullPath = rootDir + path;
+    auto& identity = result.variants[
+            static_cast<size_t>(http::content_encoding::identity)];
+    if (stat(fullPath.c_str(), &result.stat) < 0
+            || !readFile(fullPath, identity.body))
+        return false;
+    result.path = path;
+
+    const auto type = http::mimeType(path);
+    const auto etag = http::entityTag(result.stat);
+    const auto lastModified = http::httpDate(result.stat.st_mtime);
+    makeVariant(identity, type, http::content_encoding::identity, etag
+              , lastModified);
+    if (!http::isCompressible(type))
+        return true;
+
+    for (const auto encoding: {http::content_encoding::gzip
+                             , http::content_encoding::br}) {
+        auto& v = result.variants[static_cast<size_t>(encoding)];
+        if (readFile(fullPath + http::encodingSuffix(encoding), v.body)
+                || (encoding == http::content_encoding::gzip
+                    && http::gzipCompress(identity.body, v.body)))
+            makeVariant(v, type, encoding, etag, lastModified);
+    }
+    return true;
+}
+
+/**
+ * @brief Find a seed for every bucket, so all paths get distinct slots.
+ *
+ * @param hashes - Path hashes.
+ * @param seeds - Output seeds of buckets.
+ * @param slots - Output slots of paths.
+ */
+void placeEntries(const std::vector<uint64_t>& hashes
+                , std::vector<uint32_t>& seeds, std::vector<size_t>& slots) {
+    const auto count = static_cast<uint32_t>(hashes.size());
+    const auto bucketCount = static_cast<uint32_t>(seeds.size());
+    std::vector<std::vector<size_t>> buckets(bucketCount);
+    for (size_t i = 0; i < hashes.size(); ++i)
+        buckets[bucketOf(hashes[i], bucketCount)].push_back(i);
+
+    // Large buckets are placed first, while there are many free slots.
+    std::vector<size_t> order(bucketCount);
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&buckets](size_t a, size_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    std::vector<bool> taken(count);
+    std::vector<size_t> candidate;
+    for (const auto b: order) {
+        const auto& members = buckets[b];
+        if (members.empty())
+            break;
+        uint32_t seed = 1;
+        for (; seed < MAX_SEED; ++seed) {
+            candidate.clear();
+            for (const auto i: members) {
+                const auto slot = slotOf(hashes[i], seed, count);
+                if (taken[slot] || std::find(candidate.begin()
+                                           , candidate.end(), slot)
+                                   != candidate.end())
+                    break;
+                candidate.push_back(slot);
+            }
+            if (candidate.size() == members.size())
+                break;
+        }
+        if (seed == MAX_SEED)
+            throw std::runtime_error("Can't build a perfect hash of paths");
+        seeds[b] = seed;
+        for (size_t j = 0; j < members.size(); ++j) {
+            taken[candidate[j]] = true;
+            slots[members[j]] = candidate[j];
+        }
+    }
+}
+
+http::bundle_blob appendMeta(std::string& meta, uint64_t metaOffset
+                           , const std::string& data) {
+    const http::bundle_blob result{metaOffset + meta.size(), data.size()};
+    meta += data;
+    return result;
+}
+}
+
+namespace http {
+constexpr size_t bundle_entry::VARIANTS_COUNT;
+constexpr char bundle_header::MAGIC[8];
+constexpr uint32_t bundle_header::VERSION;
+
+bundle::bundle(const std::string& path, bool populate) {
+    const auto file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0)
+        throw std::runtime_error("Can't open bundle " + path);
+    struct stat fileStat;
+    if (fstat(file, &fileStat) < 0
+            || static_cast<size_t>(fileStat.st_size) < sizeof(bundle_header)) {
+        close(file);
+        throw std::runtime_error("Invalid bundle " + path);
+    }
+
+    m_size = fileStat.st_size;
+    const auto memory = mmap(nullptr, m_size, PROT_READ
+                           , MAP_PRIVATE | (populate ? MAP_POPULATE : 0)
+                           , file, 0);
+    close(file);
+    if (memory == MAP_FAILED)
+        throw std::runtime_error("Can't map bundle " + path);
+    // Huge pages of file mappings depend on the file system, so the advice
+    // may be ignored.
+    if (populate)
+        madvise(memory, m_size, MADV_HUGEPAGE);
+
+    m_data = static_cast<const char*>(memory);
+    m_header = reinterpret_cast<const bundle_header*>(m_data);
+    try {
+        validate();
+    } catch (...) {
+        munmap(memory, m_size);
+        throw;
+    }
+    m_seeds = reinterpret_cast<const uint32_t*>(m_data + m_header->seedsOffset);
+    m_entries = reinterpret_cast<const bundle_entry*>(
+            m_data + m_header->entriesOffset);
+}
+
+bundle::~bundle() {
+    munmap(const_cast<char*>(m_data), m_size);
+}
+
+void bundle::validate() const {
+    const auto& h = *m_header;
+    if (!std::equal(h.magic, h.magic + sizeof(h.magic), bundle_header::MAGIC)
+            || h.version != bundle_header::VERSION || h.size != m_size
+            || h.bucketCount == 0
+            || h.seedsOffset % alignof(uint32_t) != 0
+            || h.entriesOffset % alignof(bundle_entry) != 0
+            || !isInside({h.seedsOffset, uint64_t(h.bucketCount)
+                                         * sizeof(uint32_t)}, m_size)
+            || !isInside({h.entriesOffset, uint64_t(h.count)
+                                           * sizeof(bundle_entry)}, m_size))
+        throw std::runtime_error("Invalid bundle header");
+
+    const auto entries = reinterpret_cast<const bundle_entry*>(
+            m_data + h.entriesOffset);
+    for (size_t i = 0; i < h.count; ++i) {
+        const auto& e = entries[i];
+        auto valid = isInside(e.path, m_size);
+        for (const auto& v: e.variants) {
+            valid = valid && isInside(v.head, m_size)
+                  && isInside(v.notModifiedHead, m_size)
+                  && isInside(v.etag, m_size) && isInside(v.body, m_size);
+        }
+        if (!valid || e.variants[0].head.size == 0)
+            throw std::runtime_error("Invalid bundle entry");
+    }
+}
+
+const bundle_entry* bundle::find(const char* path, size_t size) const noexcept {
+    const auto count = m_header->count;
+    if (count == 0)
+        return nullptr;
+    const auto hash = hashPath(path, size);
+    const auto seed = m_seeds[bucketOf(hash, m_header->bucketCount)];
+    const auto& entry = m_entries[slotOf(hash, seed, count)];
+    const auto entryPath = blob(entry.path);
+    if (entryPath.size != size || std::memcmp(entryPath.data, path, size) != 0)
+        return nullptr;
+    return &entry;
+}
+
+size_t packBundle(const std::string& rootDir, const std::string& path) {
+    std::vector<std::string> paths;
+    listFiles(rootDir, "", paths);
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<packed_file> files;
+    files.reserve(paths.size());
+    for (const auto& p: paths) {
+        files.emplace_back();
+        if (!packFile(rootDir, p, files.back()))
+            throw std::runtime_error("Can't read " + rootDir + p);
+    }
+
+    std::vector<uint64_t> hashes;
+    for (const auto& f: files)
+        hashes.push_back(hashPath(f.path.data(), f.path.size()));
+    std::vector<uint32_t> seeds(files.size() / 2 + 1);
+    std::vector<size_t> slots(files.size());
+    placeEntries(hashes, seeds, slots);
+
+    bundle_header header{};
+    std::copy(bundle_header::MAGIC, bundle_header::MAGIC + 8, header.magic);
+    header.version = bundle_header::VERSION;
+    header.count = static_cast<uint32_t>(files.size());
+    header.bucketCount = static_cast<uint32_t>(seeds.size());
+    header.seedsOffset = sizeof(bundle_header);
+    header.entriesOffset = alignUp(header.seedsOffset
+                                   + seeds.size() * sizeof(uint32_t)
+                                 , alignof(bundle_entry));
+    const auto metaOffset = header.entriesOffset
+                          + files.size() * sizeof(bundle_entry);
+
+    std::vector<bundle_entry> entries(files.size());
+    std::string meta;
+    for (size_t i = 0; i < files.size(); ++i) {
+        const auto& f = files[i];
+        auto& e = entries[slots[i]];
+        std::memset(&e, 0, sizeof(e));
+        e.path = appendMeta(meta, metaOffset, f.path);
+        e.modified = f.stat.st_mtime;
+        for (size_t j = 0; j < bundle_entry::VARIANTS_COUNT; ++j) {
+            const auto& v = f.variants[j];
+            if (!v.present)
+                continue;
+            e.variants[j].head = appendMeta(meta, metaOffset, v.head);
+            e.variants[j].notModifiedHead = appendMeta(meta, metaOffset
+                                                     , v.notModifiedHead);
+            e.variants[j].etag = appendMeta(meta, metaOffset, v.etag);
+        }
+    }
+
+    // Bodies follow in the order of files, every one from a page boundary.
+    auto offset = metaOffset + meta.size();
+    for (size_t i = 0; i < files.size(); ++i) {
+        for (size_t j = 0; j < bundle_entry::VARIANTS_COUNT; ++j) {
+            const auto& v = files[i].variants[j];
+            if (!v.present)
+                continue;
+            offset = alignUp(offset, BODY_ALIGNMENT);
+            entries[slots[i]].variants[j].body = {offset, v.body.size()};
+            offset += v.body.size();
+        }
+    }
+    header.size = offset;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    const auto pad = [&out](uint64_t to) {
+        const auto at = static_cast<uint64_t>(out.tellp());
+        if (to > at)
+            out.write(std::string(to - at, '\0').data(), to - at);
+    };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(seeds.data())
+            , seeds.size() * sizeof(uint32_t));
+    pad(header.entriesOffset);
+    out.write(reinterpret_cast<const char*>(entries.data())
+            , entries.size() * sizeof(bundle_entry));
+    out.write(meta.data(), meta.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        for (size_t j = 0; j < bundle_entry::VARIANTS_COUNT; ++j) {
+            const auto& v = files[i].variants[j];
+            if (!v.present)
+                continue;
+            pad(entries[slots[i]].variants[j].body.offset);
+            out.write(v.body.data(), v.body.size());
+        }
+    }
+    out.close();
+    if (!out)
+        throw std::runtime_error("Can't write bundle " + path);
+    return files.size();
+}
+} // namespace http
@@ -0,0 +1,142 @@
+/*
+ * bundle.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "arena.h"
+
+namespace http {
+/**
+ * @brief Location of bytes in a bundle file.
+ */
+struct bundle_blob {
+    uint64_t offset;
+    uint64_t size;
+};
+
+/**
+ * @brief One representation of a file: identity, gzip or brotli.
+ * A missing variant has an empty head.
+ */
+struct bundle_variant {
+    /// Head of 200 reply without the Connection header.
+    bundle_blob head;
+    /// Head of 304 reply without the Connection header.
+    bundle_blob notModifiedHead;
+    /// Quoted entity tag of the variant.
+    bundle_blob etag;
+    /// Page aligned contents.
+    bundle_blob body;
+};
+
+/**
+ * @brief File of a bundle. Variants are indexed by content_encoding.
+ */
+struct bundle_entry {
+    static constexpr size_t VARIANTS_COUNT = 3;
+
+    /// Path relative to the packed directory, e.g. "css/site.css".
+    bundle_blob path;
+    /// Modification time of the file.
+    int64_t modified;
+    bundle_variant variants[VARIANTS_COUNT];
+};
+
+/**
+ * @brief Header at the beginning of a bundle file.
+ * The file continues with bucket seeds of the perfect hash, entries, one
+ * area of paths, tags and heads and page aligned bodies. All numbers are in
+ * the host byte order.
+ */
+struct bundle_header {
+    static constexpr char MAGIC[8] = {'H', 'T', 'T', 'P', 'P', 'A', 'C', 'K'};
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    /// Count of entries, it is the size of the hash table as well.
+    uint32_t count;
+    /// Count of hash buckets, each has a seed which places its entries.
+    uint32_t bucketCount;
+    uint32_t reserved;
+    uint64_t seedsOffset;
+    uint64_t entriesOffset;
+    /// Size of the whole file.
+    uint64_t size;
+};
+
+/**
+ * @brief Read-only memory mapped bundle of a directory made by packBundle().
+ * A path is found with one probe of a perfect hash table, and heads and
+ * bodies are sent straight from the mapping. The bundle is immutable, so
+ * it may be shared by all workers without locks.
+ */
+class bundle {
+    public:
+        /**
+         * @brief Map and validate a bundle file.
+         *
+         * @param path - Bundle file.
+         * @param populate - Read the whole file into memory at once and
+         * ask for huge pages.
+         */
+        bundle(const std::string& path, bool populate) noexcept(false);
+        ~bundle();
+
+        bundle(const bundle&) = delete;
+        bundle& operator=(const bundle&) = delete;
+
+        /**
+         * @brief Find a file.
+         *
+         * @param path - Path relative to the packed directory.
+         * @param size - Path size.
+         *
+         * @return Entry or nullptr.
+         */
+        const bundle_entry* find(const char* path, size_t size) const noexcept;
+
+        const_buffer blob(const bundle_blob& b) const noexcept {
+            return {m_data + b.offset, static_cast<size_t>(b.size)};
+        }
+
+        size_t count() const noexcept {
+            return m_header->count;
+        }
+
+    private:
+        void validate() const;
+
+    private:
+        const char* m_data;
+        size_t m_size;
+        const bundle_header* m_header;
+        const uint32_t* m_seeds;
+        const bundle_entry* m_entries;
+};
+
+/**
+ * @brief Pack regular files of a directory tree into a bundle.
+ * Compressible files get gzip and brotli variants from their precompressed
+ * siblings; without a gzip sibling the file is compressed if zlib is
+ * available.
+ *
+ * @param rootDir - Directory ending with '/'.
+ * @param path - Output bundle file.
+ *
+ * @return Count of packed files.
+ */
+size_t packBundle(const std::string& rootDir, const std::string& path)
+    noexcept(false);
+} // namespace http
+
+#endif /* !BUNDLE_H */
@@ -0,0 +1,100 @@
+/*
+ * byte_range.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "byte_range.h"
+
+#include <algorithm>
+#include <strings.h>
+
+namespace {
+constexpr char UNIT[] = "bytes=";
+constexpr size_t UNIT_SIZE = sizeof(UNIT) - 1;
+/// Larger positions are clipped, they are beyond any file anyway.
+constexpr off_t MAX_POSITION = off_t(1) << 60;
+
+bool isDigit(char ch) {
+    return ch >= '0' && ch <= '9';
+}
+
+bool isSpace(char ch) {
+    return ch == ' ' || ch == '\t';
+}
+
+/**
+ * @brief Parse a decimal number.
+ *
+ * @return Pointer after the number or nullptr if there are no digits.
+ */
+const char* parseNumber(const char* it, const char* end, off_t& result) {
+    if (it == end || !isDigit(*it))
+        return nullptr;
+    result = 0;
+    for (; it != end && isDigit(*it); ++it) {
+        // Checked before multiplying, so a long number can't overflow.
+        if (result > (MAX_POSITION - 9) / 10)
+            result = MAX_POSITION;
+        else
+            result = result * 10 + (*it - '0');
+    }
+    return it;
+}
+}
+
+namespace http {
+range_status parseRanges(const char* value, size_t size, off_t fileSize
+                       , std::vector<byte_range>& ranges) {
+    ranges.clear();
+    if (size < UNIT_SIZE || strncasecmp(value, UNIT, UNIT_SIZE) != 0)
+        return range_status::ignored;
+
+    const auto end = value + size;
+    size_t count = 0;
+    for (auto it = value + UNIT_SIZE; it < end; ) {
+        const auto specEnd = std::find(it, end, ',');
+        const auto specBegin = std::find_if_not(it, specEnd, isSpace);
+        auto specLast = specEnd;
+        while (specLast != specBegin && isSpace(specLast[-1]))
+            --specLast;
+        it = specEnd == end ? end : specEnd + 1;
+        if (specBegin == specLast)
+            continue;
+        if (++count > MAX_RANGES)
+            return range_status::ignored;
+
+        byte_range range;
+        if (*specBegin == '-') {
+            off_t suffix;
+            if (parseNumber(specBegin + 1, specLast, suffix) != specLast)
+                return range_status::ignored;
+            if (suffix == 0 || fileSize == 0)
+                continue;
+            range.first = std::max<off_t>(0, fileSize - suffix);
+            range.last = fileSize - 1;
+        } else {
+            auto pos = parseNumber(specBegin, specLast, range.first);
+            if (!pos || pos == specLast || *pos != '-')
+                return range_status::ignored;
+            ++pos;
+            range.last = MAX_POSITION;
+            if (pos != specLast && parseNumber(pos, specLast, range.last)
+                    != specLast)
+                return range_status::ignored;
+            if (range.last < range.first)
+                return range_status::ignored;
+            if (range.first >= fileSize)
+                continue;
+            range.last = std::min(range.last, fileSize - 1);
+        }
+        ranges.push_back(range);
+    }
+
+    if (count == 0)
+        return range_status::ignored;
+    return ranges.empty() ? range_status::unsatisfiable
+                          : range_status::satisfiable;
+}
+} // namespace http
@@ -0,0 +1,54 @@
+/*
+ * byte_range.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef BYTE_RANGE_H
+#define BYTE_RANGE_H
+
+#include <cstddef>
+#include <sys/types.h>
+#include <vector>
+
+namespace http {
+/**
+ * @brief Range of file bytes, both offsets are inclusive.
+ */
+struct byte_range {
+    off_t first;
+    off_t last;
+
+    off_t length() const noexcept {
+        return last - first + 1;
+    }
+};
+
+enum class range_status {
+    /// Header is malformed or too complex, the whole file is sent.
+    ignored,
+    satisfiable,
+    /// No range overlaps the file.
+    unsatisfiable
+};
+
+/// Requests with more ranges are served with the whole file.
+constexpr size_t MAX_RANGES = 16;
+
+/**
+ * @brief Parse a value of Range header.
+ * Ranges which start after the end of the file are dropped, the others are
+ * clipped to the file and kept in the request order, so every returned
+ * range lies within [0, fileSize).
+ *
+ * @param value - Header value, e.g. "bytes=0-99,200-".
+ * @param size - Header value size.
+ * @param fileSize - Size of the requested file.
+ * @param ranges - Output ranges.
+ */
+range_status parseRanges(const char* value, size_t size, off_t fileSize
+                       , std::vector<byte_range>& ranges);
+} // namespace http
+
+#endif /* !BYTE_RANGE_H */
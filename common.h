@@ -11,6 +11,8 @@
 #include <cstdio>
 #include <functional>
 #include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
 #include <utility>
 
 /**
@@ -52,4 +54,14 @@ auto callStdlibFunc(const FailCallback& callback, const Func& func, Args&& ...ar
     return funcResult;
 }
 
+/**
+ * @brief Shutdown and close a socket.
+ *
+ * @param sock - Socket descriptor.
+ */
+inline void shutdownSock(int sock) {
+    shutdown(sock, SHUT_RDWR);
+    close(sock);
+}
+
 #endif /* !COMMON_H */
@@ -0,0 +1,163 @@
+/*
+ * compression.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "compression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <strings.h>
+
+#ifdef HTTP_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+const char* const COMPRESSIBLE_TYPES[] = {
+    "application/javascript", "application/json", "application/wasm"
+  , "application/xml", "image/svg+xml"
+};
+
+bool isSpace(char ch) {
+    return ch == ' ' || ch == '\t';
+}
+
+bool equalsToken(const char* begin, const char* end, const char* token) {
+    const auto length = static_cast<size_t>(end - begin);
+    return length == std::strlen(token)
+        && strncasecmp(begin, token, length) == 0;
+}
+
+/**
+ * @brief Check if parameters of an Accept-Encoding item have q=0.
+ */
+bool hasZeroQuality(const char* params, const char* end) {
+    for (auto it = params; it + 1 < end; ++it) {
+        if ((*it != 'q' && *it != 'Q') || it[1] != '=')
+            continue;
+        auto value = it + 2;
+        if (value == end || *value != '0')
+            return false;
+        for (++value; value != end && !isSpace(*value) && *value != ';'
+                ; ++value) {
+            if (*value != '.' && *value != '0')
+                return false;
+        }
+        return true;
+    }
+    return false;
+}
+}
+
+namespace http {
+unsigned acceptedEncodings(const request_view& request) {
+    const auto header = request.find_header("Accept-Encoding");
+    if (!header)
+        return 0;
+
+    const unsigned supported = encodingBit(content_encoding::gzip)
+                             | encodingBit(content_encoding::br);
+    unsigned accepted = 0;
+    unsigned listed = 0;
+    bool any = false;
+    const auto begin = request.data(header->value);
+    const auto end = begin + header->value.length;
+    for (auto item = begin; item < end; ) {
+        const auto itemEnd = std::find(item, end, ',');
+        const auto name = std::find_if_not(item, itemEnd, isSpace);
+        const auto nameEnd = std::find_if(name, itemEnd, [](char ch) {
+            return ch == ';' || isSpace(ch);
+        });
+        const auto rejected = hasZeroQuality(nameEnd, itemEnd);
+        unsigned bit = 0;
+        if (equalsToken(name, nameEnd, "gzip")
+                || equalsToken(name, nameEnd, "x-gzip"))
+            bit = encodingBit(content_encoding::gzip);
+        else if (equalsToken(name, nameEnd, "br"))
+            bit = encodingBit(content_encoding::br);
+        else if (equalsToken(name, nameEnd, "*"))
+            any = !rejected;
+
+        listed |= bit;
+        if (!rejected)
+            accepted |= bit;
+        item = itemEnd + 1;
+    }
+    if (any)
+        accepted |= supported & ~listed;
+    return accepted;
+}
+
+const char* encodingName(content_encoding encoding) noexcept {
+    switch (encoding) {
+        case content_encoding::gzip:
+            return "gzip";
+        case content_encoding::br:
+            return "br";
+        default:
+            return "identity";
+    }
+}
+
+const char* encodingSuffix(content_encoding encoding) noexcept {
+    switch (encoding) {
+        case content_encoding::gzip:
+            return ".gz";
+        case content_encoding::br:
+            return ".br";
+        default:
+            return "";
+    }
+}
+
+bool isCompressible(const char* mimeType) noexcept {
+    if (std::strncmp(mimeType, "text/", 5) == 0)
+        return true;
+    for (const auto type: COMPRESSIBLE_TYPES) {
+        if (std::strcmp(mimeType, type) == 0)
+            return true;
+    }
+    return false;
+}
+
+std::string encodedCacheKey(const std::string& path
+                          , content_encoding encoding) {
+    if (encoding == content_encoding::identity)
+        return path;
+    // File paths never contain a zero byte.
+    auto key = path;
+    key += '\0';
+    key += encodingName(encoding);
+    return key;
+}
+
+bool gzipCompress(const std::string& data, std::string& result) {
+#ifdef HTTP_WITH_ZLIB
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    // Window bits above 15 select the gzip wrapper.
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8
+                   , Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    result.resize(deflateBound(&stream, data.size()));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&result[0]);
+    stream.avail_out = static_cast<uInt>(result.size());
+    const auto status = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END || stream.total_out >= data.size())
+        return false;
+    result.resize(stream.total_out);
+    return true;
+#else
+    (void)data;
+    (void)result;
+    return false;
+#endif
+}
+} // namespace http
@@ -0,0 +1,69 @@
+/*
+ * compression.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <string>
+
+#include "boost_parser/request_view.hpp"
+
+namespace http {
+enum class content_encoding {
+    identity,
+    gzip,
+    br
+};
+
+inline unsigned encodingBit(content_encoding encoding) noexcept {
+    return 1u << static_cast<unsigned>(encoding);
+}
+
+/**
+ * @brief Get bit mask of encodings accepted by a client.
+ * Encodings are taken from Accept-Encoding, ones with zero quality are
+ * excluded. Identity is not reported.
+ */
+unsigned acceptedEncodings(const request_view& request);
+
+/**
+ * @brief Get a name used in Content-Encoding header.
+ */
+const char* encodingName(content_encoding encoding) noexcept;
+
+/**
+ * @brief Get a suffix of a precompressed sibling file, e.g. ".gz".
+ */
+const char* encodingSuffix(content_encoding encoding) noexcept;
+
+/**
+ * @brief Check if it is worth compressing content of a MIME type.
+ */
+bool isCompressible(const char* mimeType) noexcept;
+
+/**
+ * @brief Get file_cache key of a file sent with an encoding.
+ * A cached head carries Content-Type and Content-Encoding, so the same file
+ * sent as itself and as a precompressed sibling of another file has two
+ * entries. The key of the identity encoding is the path itself, other keys
+ * can't be paths of files.
+ *
+ * @param path - File which contents is sent, e.g. "a.txt.gz" when it is
+ * the gzip variant of "a.txt" or "a.txt" when it is compressed on the fly.
+ */
+std::string encodedCacheKey(const std::string& path, content_encoding encoding);
+
+/**
+ * @brief Compress data into gzip format.
+ *
+ * @return false if the server is built without zlib or the data
+ * does not shrink.
+ */
+bool gzipCompress(const std::string& data, std::string& result);
+} // namespace http
+
+#endif /* !COMPRESSION_H */
@@ -0,0 +1,439 @@
+/*
+ * connection.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "connection.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <string.h>
+#include <strings.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <tuple>
+#include <unistd.h>
+
+#include "common.h"
+#include "logger.h"
+
+namespace {
+/**
+ * @brief Check if a client wants to keep the connection open.
+ * HTTP/1.1 connections are persistent unless "Connection: close" is sent,
+ * HTTP/1.0 ones are closed unless "Connection: keep-alive" is sent.
+ */
+bool wantsKeepAlive(const http::request_view& request) {
+    const auto header = request.find_header("Connection");
+    if (!header) {
+        return request.http_version_major > 1
+            || (request.http_version_major == 1
+                && request.http_version_minor >= 1);
+    }
+    return request.iequals(header->value, "keep-alive");
+}
+
+/**
+ * @brief Check if a request has a body.
+ * Bodies are not read, so bytes after the head of such a request can't be
+ * taken for the next request. Only "Content-Length: 0" means no body.
+ */
+bool hasBody(const http::request_view& request) {
+    for (size_t i = 0; i < request.header_count; ++i) {
+        const auto& header = request.headers[i];
+        if (request.iequals(header.name, "Transfer-Encoding"))
+            return true;
+        if (!request.iequals(header.name, "Content-Length"))
+            continue;
+        const auto value = request.data(header.value);
+        if (header.value.length == 0
+                || std::find_if(value, value + header.value.length
+                              , [](char c) { return c != '0'; })
+                   != value + header.value.length)
+            return true;
+    }
+    return false;
+}
+}
+
+namespace http {
+constexpr size_t connection::MAX_REQUEST_SIZE;
+constexpr size_t connection::MAX_REPLY_MEMORY;
+
+connection::connection(int socket, uint32_t peer
+                     , const request_handler& handler, metrics_shard& stats
+                     , buffer_pool& buffers, admission& gate)
+    : m_socket(socket)
+    , m_peer(peer)
+    , m_handler(handler)
+    , m_stats(stats)
+    , m_buffers(buffers)
+    , m_gate(gate)
+    , m_memory(buffers)
+    , m_waitStart(metrics::now())
+{
+    m_gate.opened();
+}
+
+connection::~connection() {
+    m_gate.finished(m_replies.size());
+    m_gate.closed();
+    releaseInput();
+    if (m_socket != INVALID_FD)
+        shutdownSock(m_socket);
+}
+
+void connection::onReadable() {
+    m_readPaused = false;
+    while (m_state == state::reading) {
+        parseInput();
+        if (m_replies.size() >= MAX_PIPELINED) {
+            flush();
+            if (m_replies.size() >= MAX_PIPELINED) {
+                // Resume when the client reads queued replies.
+                m_readPaused = true;
+                break;
+            }
+            continue;
+        }
+        if (m_state != state::reading || !reserveInput())
+            break;
+
+        acquireInput();
+        const auto bytesRead = read(m_socket, m_input + m_inputEnd
+                                  , m_inputSize - m_inputEnd);
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (m_inputEnd == 0)
+                releaseInput();
+            break;
+        }
+        if (bytesRead < 0) {
+            logger::message(log_level::error
+                          , "Can't read request from client: %s"
+                          , strerror(errno));
+            m_state = state::closed;
+            return;
+        }
+        if (bytesRead == 0) {
+            // Client will not send more requests, finish queued replies.
+            m_state = state::closing;
+            break;
+        }
+        receiveStarted();
+        m_inputEnd += bytesRead;
+    }
+
+    flush();
+}
+
+void connection::onWritable() {
+    flush();
+    if (m_readPaused)
+        onReadable();
+}
+
+size_t connection::prepareInput() {
+    parseInput();
+    if (m_state != state::reading || m_replies.size() >= MAX_PIPELINED
+            || !reserveInput())
+        return 0;
+    // Without a buffer one is taken from the pool when data arrives.
+    return m_input ? m_inputSize - m_inputEnd : INPUT_BUFFER_SIZE;
+}
+
+void connection::receive(const char* data, size_t size) {
+    if (size == 0) {
+        // Client will not send more requests, finish queued replies.
+        if (m_state == state::reading)
+            m_state = state::closing;
+        if (m_state == state::closing && m_replies.empty())
+            m_state = state::closed;
+        return;
+    }
+
+    acquireInput();
+    receiveStarted();
+    std::copy(data, data + size, m_input + m_inputEnd);
+    m_inputEnd += size;
+    parseInput();
+}
+
+int connection::gatherOutput(iovec* iov, int maxCount, bool& hasFile) const {
+    int count = 0;
+    size_t written = m_written;
+    hasFile = false;
+    for (const auto& reply: m_replies) {
+        if (count + response::MAX_PARTS > maxCount)
+            break;
+        count += reply.pending(iov + count, written);
+        written = 0;
+        hasFile = reply.hasFile();
+        // Next segment is gathered when this one is sent.
+        if (hasFile || !reply.segments.empty())
+            break;
+    }
+    return count;
+}
+
+void connection::advanceOutput(size_t sent) {
+    m_stats.bytesSent.add(sent);
+    // Any progress restarts the send deadline, when the last reply is sent
+    // the idle time starts.
+    if (sent > 0)
+        m_waitStart = metrics::now();
+    while (sent > 0) {
+        auto& reply = m_replies.front();
+        const auto memoryLeft = reply.memorySize() - m_written;
+        if (memoryLeft > 0) {
+            const auto step = std::min(sent, memoryLeft);
+            m_written += step;
+            sent -= step;
+        } else {
+            // File bytes are sent only up to the end of the file part.
+            reply.fileOffset += sent;
+            sent = 0;
+        }
+        if (m_written == reply.memorySize() && !reply.hasFile()) {
+            if (reply.nextSegment())
+                m_written = 0;
+            else
+                popReply();
+        }
+    }
+
+    if (m_state == state::closing && m_replies.empty())
+        m_state = state::closed;
+}
+
+void connection::drain() noexcept {
+    m_draining = true;
+    if (m_state != state::reading)
+        return;
+    if (m_inputEnd > m_requestBegin) {
+        // The reply to the request being received closes the connection.
+        return;
+    }
+    if (m_replies.empty()) {
+        // A just connected client is about to send its request.
+        if (m_answered)
+            m_state = state::closed;
+        return;
+    }
+
+    for (auto& reply: m_replies) {
+        // Connection header of a reply is sent with its head.
+        if (&reply != &m_replies.front()
+                || (m_written == 0 && !reply.continued))
+            reply.keepAlive = false;
+    }
+    if (!m_replies.back().keepAlive)
+        m_state = state::closing;
+}
+
+uint64_t connection::deadline(const connection_timeouts& timeouts) const
+        noexcept {
+    uint64_t timeout;
+    if (!m_replies.empty())
+        timeout = timeouts.send;
+    else if (m_inputEnd > m_requestBegin)
+        timeout = timeouts.header;
+    else
+        timeout = timeouts.idle;
+    return timeout ? m_waitStart + timeout : 0;
+}
+
+void connection::receiveStarted() {
+    // Header deadline counts from the first byte of a request, so a client
+    // can't extend it by sending a byte at a time.
+    if (m_replies.empty() && m_inputEnd == m_requestBegin)
+        m_waitStart = metrics::now();
+}
+
+void connection::acquireInput() {
+    if (m_input)
+        return;
+    m_input = m_buffers.acquire();
+    m_inputSize = INPUT_BUFFER_SIZE;
+}
+
+void connection::releaseInput() noexcept {
+    if (m_largeInput)
+        m_largeInput.reset();
+    else if (m_input)
+        m_buffers.release(m_input);
+    m_input = nullptr;
+    m_inputSize = 0;
+}
+
+bool connection::reserveInput() {
+    if (!m_input || m_inputEnd < m_inputSize)
+        return true;
+
+    if (m_requestBegin > 0) {
+        // Move the unfinished request to the beginning of the buffer.
+        std::copy(m_input + m_requestBegin, m_input + m_inputEnd, m_input);
+        m_inputEnd -= m_requestBegin;
+        m_inputParsed -= m_requestBegin;
+        m_requestBegin = 0;
+        return true;
+    }
+
+    if (m_inputSize < MAX_REQUEST_SIZE) {
+        // Large requests are rare, so larger buffers are not pooled.
+        const auto size = std::min(m_inputSize * 2, MAX_REQUEST_SIZE);
+        std::unique_ptr<char[]> larger(new char[size]);
+        std::copy(m_input, m_input + m_inputEnd, larger.get());
+        releaseInput();
+        m_largeInput = std::move(larger);
+        m_input = m_largeInput.get();
+        m_inputSize = size;
+        return true;
+    }
+
+    logger::message(log_level::debug, "Request is too large");
+    queueReply(makeNotFound());
+    return false;
+}
+
+void connection::parseInput() {
+    while (m_inputParsed < m_inputEnd && m_state == state::reading
+            && m_replies.size() < MAX_PIPELINED) {
+        const auto begin = m_input + m_inputParsed;
+        const auto end = m_input + m_inputEnd;
+        request_parser::result_type parseResult;
+        const char* parsedEnd;
+        const auto parseStart = metrics::now();
+        std::tie(parseResult, parsedEnd) = m_parser.parse(m_request
+                                                        , begin, end);
+        m_parseTime += metrics::now() - parseStart;
+        m_inputParsed += parsedEnd - begin;
+        if (parseResult == request_parser::good) {
+            m_stats.parseTime.record(m_parseTime);
+            m_parseTime = 0;
+            m_request.base = m_input + m_requestBegin;
+            const auto lookupStart = metrics::now();
+            response reply;
+            uint64_t lookupTime = 0;
+            if (hasBody(m_request)) {
+                // The reply closes the connection, so the body is never
+                // parsed.
+                reply = makeNotFound();
+            } else if (m_gate.admit(lookupStart)) {
+                reply = m_handler.handle(m_request, m_memory);
+                lookupTime = metrics::now() - lookupStart;
+                m_stats.lookupTime.record(lookupTime);
+                reply.keepAlive = wantsKeepAlive(m_request);
+            } else {
+                reply = m_gate.reject();
+            }
+            // Method and URI are separated by a single space in the buffer.
+            const auto requestLine = m_request.data(m_request.method);
+            logger::access(m_peer, requestLine
+                         , m_request.data(m_request.uri) + m_request.uri.length
+                           - requestLine
+                         , reply.status, reply.size(), lookupTime);
+            queueReply(std::move(reply));
+            m_request.clear();
+            m_parser.reset();
+            m_requestBegin = m_inputParsed;
+        }
+        else if (parseResult == request_parser::bad) {
+            m_stats.parseErrors.add();
+            auto reply = makeNotFound();
+            logger::access(m_peer, "-", 1, reply.status, reply.size(), 0);
+            queueReply(std::move(reply));
+        }
+    }
+
+    if (m_requestBegin == m_inputEnd) {
+        // Everything is parsed, the buffer goes back to the pool until
+        // more data arrives.
+        m_requestBegin = m_inputParsed = m_inputEnd = 0;
+        releaseInput();
+    }
+}
+
+void connection::queueReply(response&& reply) {
+    if (m_draining)
+        reply.keepAlive = false;
+    if (m_memory.size() > MAX_REPLY_MEMORY && reply.keepAlive) {
+        logger::message(log_level::debug, "Reply heads take too much memory");
+        reply.keepAlive = false;
+    }
+    if (!reply.keepAlive)
+        m_state = state::closing;
+    m_answered = true;
+    reply.queueTime = metrics::now();
+    reply.memoryEnd = m_memory.position();
+    if (m_replies.empty())
+        m_waitStart = reply.queueTime;
+    m_stats.countReply(reply.status);
+    m_gate.started();
+    m_replies.push_back(std::move(reply));
+}
+
+void connection::popReply() {
+    const auto& reply = m_replies.front();
+    m_stats.sendTime.record(metrics::now() - reply.queueTime);
+    // Heads of the next replies were allocated after this one was queued.
+    if (m_replies.size() == 1)
+        m_memory.reset();
+    else
+        m_memory.release(reply.memoryEnd);
+    m_replies.pop_front();
+    m_gate.finished();
+    m_written = 0;
+    // The last reply was started before draining and kept the connection.
+    if (m_replies.empty() && m_draining && m_state == state::reading
+            && m_inputEnd == m_requestBegin)
+        m_state = state::closing;
+}
+
+void connection::flush() {
+    iovec iov[MAX_IOV];
+    while (!m_replies.empty()) {
+        bool hasFile = false;
+        const auto count = gatherOutput(iov, MAX_IOV, hasFile);
+        ssize_t bytesSent;
+        if (count > 0) {
+            msghdr message{};
+            message.msg_iov = iov;
+            message.msg_iovlen = count;
+            // MSG_MORE lets the kernel coalesce the head with the file body.
+            bytesSent = sendmsg(m_socket, &message
+                              , MSG_NOSIGNAL | (hasFile ? MSG_MORE : 0));
+        } else {
+            // In-memory parts of the first reply are sent, its file is left.
+            const auto& reply = m_replies.front();
+            auto offset = reply.fileOffset;
+            bytesSent = sendfile(m_socket, reply.file, &offset
+                               , reply.fileEnd - reply.fileOffset);
+            if (bytesSent == 0) {
+                // The file was truncated while it was being sent.
+                m_state = state::closed;
+                return;
+            }
+        }
+
+        if (bytesSent < 0 && errno == EINTR)
+            continue;
+        if (bytesSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (bytesSent < 0) {
+            logger::message(log_level::debug, "Can't send reply: %s"
+                          , strerror(errno));
+            m_state = state::closed;
+            return;
+        }
+        advanceOutput(bytesSent);
+    }
+
+    if (m_state == state::closing)
+        m_state = state::closed;
+}
+} // namespace http
@@ -0,0 +1,239 @@
+/*
+ * connection.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "admission.h"
+#include "arena.h"
+#include "boost_parser/request_parser.hpp"
+#include "boost_parser/request_view.hpp"
+#include "buffer_pool.h"
+#include "metrics.h"
+#include "request_handler.h"
+#include "response.h"
+
+namespace http {
+/**
+ * @brief Deadlines of client connections in nanoseconds.
+ * Zero disables a deadline.
+ */
+struct connection_timeouts {
+    /// Time to receive a whole request since its first byte.
+    uint64_t header = 0;
+    /// Time a queued reply may wait for the client to read any of it.
+    uint64_t send = 0;
+    /// Time a connection may stay without requests and replies.
+    uint64_t idle = 0;
+};
+
+/**
+ * @brief State of one client connection driven by an event loop.
+ * The socket must be non-blocking. Connection reads requests incrementally,
+ * without copying them out of its receive buffer,
+ * keeps the socket open between requests when the client allows it and
+ * answers pipelined requests in order, batching queued replies into one
+ * sendmsg call. Socket is closed when the connection object is destroyed.
+ * Receive buffer is taken from the pool of the loop only while a request
+ * is being received and reply heads live in an arena which frees them as
+ * replies are sent, so an idle connection holds no buffers. A connection
+ * which heads outgrow MAX_REPLY_MEMORY is closed after its queued replies.
+ * Every parsed request passes the admission control of the loop, a shed
+ * one is answered with 503 and the connection is closed after it.
+ * Connection may be driven by readiness events with onReadable() and
+ * onWritable(), which do I/O on the socket themselves, or by completion
+ * based I/O with prepareInput(), receive(), gatherOutput() and
+ * advanceOutput(), which leave I/O to the caller.
+ */
+class connection {
+    public:
+        static constexpr int INVALID_FD = -1;
+        /// Maximum count of buffers gathered for one send.
+        static constexpr int MAX_IOV = 64;
+
+        /**
+         * @brief Construct a connection.
+         *
+         * @param socket - Accepted non-blocking client socket or INVALID_FD
+         * if I/O is done by the caller.
+         * @param peer - Client IPv4 address in network byte order.
+         * @param handler - Request handler. It must outlive the connection.
+         * @param stats - Metrics of the owner thread.
+         * @param buffers - Buffer pool of the owner thread. It must outlive
+         * the connection.
+         * @param gate - Admission control of the owner thread. It must
+         * outlive the connection.
+         */
+        connection(int socket, uint32_t peer, const request_handler& handler
+                 , metrics_shard& stats, buffer_pool& buffers
+                 , admission& gate);
+        ~connection();
+
+        connection(const connection&) = delete;
+        connection& operator=(const connection&) = delete;
+
+        /**
+         * @brief Read everything available from the socket and parse it.
+         */
+        void onReadable();
+
+        /**
+         * @brief Write pending replies until the socket would block.
+         */
+        void onWritable();
+
+        /**
+         * @brief Parse buffered input and reserve space for more.
+         *
+         * @return Count of bytes which may be passed to receive().
+         * Zero if the connection does not read input now: replies are
+         * queued up to the limit or no more requests are accepted.
+         */
+        size_t prepareInput();
+
+        /**
+         * @brief Append received bytes and parse them.
+         *
+         * @param data - Received bytes.
+         * @param size - Count of bytes, not more than prepareInput()
+         * returned. Zero means the client finished sending.
+         */
+        void receive(const char* data, size_t size);
+
+        /**
+         * @brief Describe in-memory reply parts which are not sent yet.
+         * If it returns zero and hasFile is set, the file of the first
+         * queued reply is to be sent from its current offset.
+         *
+         * @param iov - Output buffers.
+         * @param maxCount - Size of iov, at least response::MAX_PARTS.
+         * @param hasFile - Set if a file body follows the described buffers.
+         *
+         * @return Count of filled buffers.
+         */
+        int gatherOutput(iovec* iov, int maxCount, bool& hasFile) const;
+
+        /**
+         * @brief Mark bytes described by gatherOutput() or bytes of the
+         * first reply file as sent.
+         */
+        void advanceOutput(size_t sent);
+
+        /**
+         * @brief Get the first queued reply.
+         */
+        const response& frontReply() const noexcept {
+            return m_replies.front();
+        }
+
+        bool hasOutput() const noexcept {
+            return !m_replies.empty();
+        }
+
+        /**
+         * @brief Stop serving the client after an I/O error.
+         */
+        void abort() noexcept {
+            m_state = state::closed;
+        }
+
+        /**
+         * @brief Close the connection after the reply to the request being
+         * received or at once if it is idle.
+         * Queued replies which are not started yet tell the client that
+         * the connection is closed.
+         */
+        void drain() noexcept;
+
+        /**
+         * @brief Get the time when the connection should be dropped.
+         * The deadline depends on what the connection waits for: the rest
+         * of a request, the client to read a reply or a new request.
+         *
+         * @return Zero if the current deadline is disabled.
+         */
+        uint64_t deadline(const connection_timeouts& timeouts) const noexcept;
+
+        /**
+         * @brief Check if the connection is finished and may be destroyed.
+         */
+        bool closed() const noexcept {
+            return m_state == state::closed;
+        }
+
+    private:
+        enum class state {
+            /// Reading and answering requests.
+            reading,
+            /// No more requests are accepted, sending queued replies.
+            closing,
+            closed
+        };
+
+        /// Replies queued before reading from the socket is paused.
+        static constexpr size_t MAX_PIPELINED = 16;
+        static constexpr size_t INPUT_BUFFER_SIZE = buffer_pool::BUFFER_SIZE;
+        static constexpr size_t MAX_REQUEST_SIZE = 65536;
+        /// Arena size after which no more requests are read.
+        static constexpr size_t MAX_REPLY_MEMORY = 65536;
+
+        void receiveStarted();
+        void acquireInput();
+        void releaseInput() noexcept;
+        bool reserveInput();
+        void parseInput();
+        void queueReply(response&& reply);
+        void popReply();
+        void flush();
+
+    private:
+        int m_socket;
+        uint32_t m_peer;
+        const request_handler& m_handler;
+        metrics_shard& m_stats;
+        buffer_pool& m_buffers;
+        admission& m_gate;
+        /// Memory of queued reply heads.
+        arena m_memory;
+        state m_state = state::reading;
+        request_view m_request;
+        request_parser m_parser;
+        /// Time spent by the parser on the current request.
+        uint64_t m_parseTime = 0;
+        /// Receive buffer or nullptr. Parsed request refers to it.
+        char* m_input = nullptr;
+        size_t m_inputSize = 0;
+        /// Owner of the receive buffer when a request outgrows a pool one.
+        std::unique_ptr<char[]> m_largeInput;
+        /// Offset of the first byte of the request being parsed.
+        size_t m_requestBegin = 0;
+        /// Offset of the first byte not passed to the parser.
+        size_t m_inputParsed = 0;
+        /// Offset after the last received byte.
+        size_t m_inputEnd = 0;
+        bool m_readPaused = false;
+        /// No request is read after the next reply.
+        bool m_draining = false;
+        /// At least one reply is queued, so the client is not just
+        /// connected.
+        bool m_answered = false;
+        /// Start of the current wait: a request, a reply or idle time.
+        uint64_t m_waitStart;
+        std::deque<response> m_replies;
+        /// In-memory bytes of the first queued reply which are already sent.
+        size_t m_written = 0;
+};
+} // namespace http
+
+#endif /* !CONNECTION_H */
@@ -0,0 +1,256 @@
+/*
+ * event_loop.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "event_loop.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "logger.h"
+
+namespace {
+constexpr int MAX_EVENTS = 256;
+
+inline sockaddr* sockaddrCast(sockaddr_in* v) {
+    return reinterpret_cast<sockaddr*>(v);
+}
+
+void setNonBlocking(int fd) {
+    const auto flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        perror("");
+        throw std::runtime_error("Can't make descriptor non-blocking");
+    }
+}
+}
+
+namespace http {
+event_loop::event_loop(int listenSocket, const request_handler& handler
+                     , metrics_shard& stats
+                     , const connection_timeouts& timeouts
+                     , const admission_limits& limits)
+    : m_listenSocket(listenSocket)
+    , m_handler(handler)
+    , m_stats(stats)
+    , m_timeouts(timeouts)
+    , m_gate(limits, stats)
+{
+    const auto closeOnError = [this] {
+        m_epoll != INVALID_FD ? void(close(m_epoll)) : void();
+        m_wakeFd != INVALID_FD ? void(close(m_wakeFd)) : void();
+        throw std::runtime_error("Can't construct an event loop");
+    };
+
+    m_epoll = callStdlibFunc(closeOnError, epoll_create1, EPOLL_CLOEXEC);
+    m_wakeFd = callStdlibFunc(closeOnError, eventfd, 0
+                            , EFD_NONBLOCK | EFD_CLOEXEC);
+    setNonBlocking(m_listenSocket);
+
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = m_listenSocket;
+    callStdlibFunc(closeOnError, epoll_ctl, m_epoll, EPOLL_CTL_ADD
+                 , m_listenSocket, &event);
+
+    event.events = EPOLLIN;
+    event.data.fd = m_wakeFd;
+    callStdlibFunc(closeOnError, epoll_ctl, m_epoll, EPOLL_CTL_ADD
+                 , m_wakeFd, &event);
+}
+
+event_loop::~event_loop() {
+    m_connections.clear();
+    close(m_wakeFd);
+    close(m_epoll);
+}
+
+void event_loop::run() {
+    metrics::attach(&m_stats);
+    epoll_event events[MAX_EVENTS];
+    while (!m_stopped) {
+        const auto count = epoll_wait(m_epoll, events, MAX_EVENTS
+                                    , m_timers.waitTimeout(metrics::now()));
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            logger::message(log_level::error, "Can't wait for events: %s"
+                          , strerror(errno));
+            break;
+        }
+
+        m_gate.batchStarted(metrics::now());
+        for (int i = 0; i < count; ++i) {
+            const auto fd = events[i].data.fd;
+            if (fd == m_listenSocket)
+                acceptConnections();
+            else if (fd == m_wakeFd)
+                wakeUp();
+            else
+                handleEvents(fd, events[i].events);
+        }
+        expireConnections();
+        // The listener is edge-triggered, so clients which arrived while
+        // accepting was paused are not reported again.
+        if (m_acceptPaused && m_gate.canAccept())
+            acceptConnections();
+        if (m_draining && m_gate.connections() == 0)
+            break;
+    }
+}
+
+void event_loop::stop() noexcept {
+    m_stopRequested = true;
+    const uint64_t one = 1;
+    // write(2) is async-signal-safe, so it is fine to call it from a handler.
+    const auto result = write(m_wakeFd, &one, sizeof(one));
+    static_cast<void>(result);
+}
+
+void event_loop::drain() noexcept {
+    m_drainRequested = true;
+    const uint64_t one = 1;
+    const auto result = write(m_wakeFd, &one, sizeof(one));
+    static_cast<void>(result);
+}
+
+void event_loop::wakeUp() noexcept {
+    uint64_t value;
+    const auto result = read(m_wakeFd, &value, sizeof(value));
+    static_cast<void>(result);
+    if (m_stopRequested)
+        m_stopped = true;
+    else if (m_drainRequested && !m_draining)
+        startDrain();
+}
+
+void event_loop::startDrain() {
+    logger::message(log_level::info, "Draining %zu connections"
+                  , m_gate.connections());
+    m_draining = true;
+    m_acceptPaused = false;
+    // Clients in the backlog are left to another process sharing the
+    // socket.
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, m_listenSocket, nullptr);
+    for (size_t socket = 0; socket < m_connections.size(); ++socket) {
+        if (!m_connections[socket])
+            continue;
+        m_connections[socket]->drain();
+        if (m_connections[socket]->closed())
+            closeConnection(socket);
+        else
+            updateTimer(socket);
+    }
+}
+
+void event_loop::acceptConnections() {
+    sockaddr_in sock;
+    socklen_t sockSize = sizeof(sockaddr_in);
+    while (!m_draining) {
+        if (!m_gate.canAccept()) {
+            if (!m_acceptPaused) {
+                m_acceptPaused = true;
+                m_stats.acceptPauses.add();
+                logger::message(log_level::debug, "Accepting is paused");
+            }
+            break;
+        }
+        m_acceptPaused = false;
+        const auto clientSocket = accept4(m_listenSocket, sockaddrCast(&sock)
+                                        , &sockSize
+                                        , SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientSocket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                logger::message(log_level::error
+                              , "Can't accept a connection: %s"
+                              , strerror(errno));
+            }
+            break;
+        }
+
+        m_stats.accepts.add();
+        if (logger::enabled(log_level::debug)) {
+            char address[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &sock.sin_addr, address, sizeof(address));
+            logger::message(log_level::debug, "Connected client: %s"
+                          , address);
+        }
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        event.data.fd = clientSocket;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, clientSocket, &event) < 0) {
+            logger::message(log_level::error, "Can't watch a connection: %s"
+                          , strerror(errno));
+            shutdownSock(clientSocket);
+            continue;
+        }
+
+        if (static_cast<size_t>(clientSocket) >= m_connections.size())
+            m_connections.resize(clientSocket + 1);
+        m_connections[clientSocket].reset(
+                new connection(clientSocket, sock.sin_addr.s_addr
+                             , m_handler, m_stats, m_buffers, m_gate));
+        updateTimer(clientSocket);
+    }
+}
+
+void event_loop::handleEvents(int socket, unsigned events) {
+    if (static_cast<size_t>(socket) >= m_connections.size()
+            || !m_connections[socket])
+        return;
+
+    auto& conn = *m_connections[socket];
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        return closeConnection(socket);
+    }
+
+    if (events & EPOLLIN)
+        conn.onReadable();
+    if (events & EPOLLOUT)
+        conn.onWritable();
+
+    if (conn.closed())
+        closeConnection(socket);
+    else
+        updateTimer(socket);
+}
+
+void event_loop::closeConnection(int socket) {
+    // Closing the descriptor removes it from the epoll set as well.
+    m_connections[socket].reset();
+    m_timers.cancel(socket);
+}
+
+void event_loop::updateTimer(int socket) {
+    const auto deadline = m_connections[socket]->deadline(m_timeouts);
+    if (deadline)
+        m_timers.schedule(socket, deadline);
+    else
+        m_timers.cancel(socket);
+}
+
+void event_loop::expireConnections() {
+    m_timers.expire(metrics::now(), m_expired);
+    for (const auto socket: m_expired) {
+        m_stats.timeouts.add();
+        logger::message(log_level::debug, "Client %u timed out", socket);
+        closeConnection(socket);
+    }
+}
+} // namespace http
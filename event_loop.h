@@ -0,0 +1,95 @@
+/*
+ * event_loop.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "admission.h"
+#include "connection.h"
+#include "io_loop.h"
+#include "metrics.h"
+#include "request_handler.h"
+#include "timer_wheel.h"
+
+namespace http {
+/**
+ * @brief Edge-triggered epoll reactor.
+ * It owns a listening socket and all accepted client sockets and drives
+ * each client connection state machine on readiness events.
+ */
+class event_loop: public io_loop {
+    public:
+        /**
+         * @brief Construct an event loop.
+         *
+         * @param listenSocket - Listening socket. Loop makes it non-blocking
+         * but does not close it.
+         * @param handler - Request handler. It must outlive the loop.
+         * @param stats - Metrics shard owned by the loop thread.
+         * It must outlive the loop.
+         * @param timeouts - Deadlines of client connections.
+         * @param limits - Overload limits of the loop.
+         */
+        event_loop(int listenSocket, const request_handler& handler
+                 , metrics_shard& stats
+                 , const connection_timeouts& timeouts
+                 , const admission_limits& limits) noexcept(false);
+        ~event_loop() override;
+
+        event_loop(const event_loop&) = delete;
+        event_loop& operator=(const event_loop&) = delete;
+
+        /**
+         * @brief Dispatch events until stop() is called.
+         */
+        void run() override;
+
+        void stop() noexcept override;
+        void drain() noexcept override;
+
+    private:
+        void wakeUp() noexcept;
+        void startDrain();
+        void acceptConnections();
+        void handleEvents(int socket, unsigned events);
+        void closeConnection(int socket);
+        void updateTimer(int socket);
+        void expireConnections();
+
+    private:
+        static constexpr int INVALID_FD = -1;
+        int m_epoll = INVALID_FD;
+        int m_wakeFd = INVALID_FD;
+        int m_listenSocket;
+        const request_handler& m_handler;
+        metrics_shard& m_stats;
+        const connection_timeouts m_timeouts;
+        bool m_stopped = false;
+        /// Requests of other threads, they come with a wake-up.
+        std::atomic<bool> m_stopRequested{false};
+        std::atomic<bool> m_drainRequested{false};
+        /// Listening socket is not watched, the loop ends with the last
+        /// connection.
+        bool m_draining = false;
+        /// Clients are left in the listen backlog until limits allow more.
+        bool m_acceptPaused = false;
+        admission m_gate;
+        /// Receive buffers and reply heads of all connections.
+        buffer_pool m_buffers;
+        std::vector<std::unique_ptr<connection>> m_connections;
+        /// Deadlines of connections indexed by their sockets.
+        timer_wheel m_timers;
+        std::vector<unsigned> m_expired;
+};
+} // namespace http
+
+#endif /* !EVENT_LOOP_H */
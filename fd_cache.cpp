@@ -0,0 +1,102 @@
+/*
+ * fd_cache.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "fd_cache.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <functional>
+#include <iterator>
+#include <unistd.h>
+
+#include "response.h"
+
+namespace http {
+constexpr int open_file::INVALID_FD;
+
+open_file::open_file(const std::string& path, uint64_t expires)
+    : fd(open(path.c_str(), O_RDONLY | O_CLOEXEC))
+    , expires(expires)
+{
+    if (fd == INVALID_FD)
+        return;
+    if (fstat(fd, &stat) < 0 || !S_ISREG(stat.st_mode)) {
+        close(fd);
+        fd = INVALID_FD;
+        return;
+    }
+    etag = entityTag(stat);
+    lastModified = httpDate(stat.st_mtime);
+    validators = validatorHeaders(etag, lastModified);
+}
+
+open_file::~open_file() {
+    if (fd != INVALID_FD)
+        close(fd);
+}
+
+fd_cache::fd_cache(size_t capacity, uint64_t validity)
+    : m_shardCapacity(std::max<size_t>(1, capacity / SHARDS_COUNT))
+    , m_validity(validity)
+    , m_shards(new shard[SHARDS_COUNT])
+{}
+
+fd_cache::shard& fd_cache::shardFor(const std::string& path) {
+    return m_shards[std::hash<std::string>()(path) % SHARDS_COUNT];
+}
+
+fd_cache::entry_ptr fd_cache::find(const std::string& path, uint64_t now) {
+    auto& s = shardFor(path);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    const auto it = s.index.find(path);
+    if (it == s.index.end())
+        return nullptr;
+
+    if (it->second->second->expires <= now) {
+        eraseLocked(s, it->second);
+        return nullptr;
+    }
+    s.lru.splice(s.lru.begin(), s.lru, it->second);
+    return it->second->second;
+}
+
+void fd_cache::insert(const std::string& path, entry_ptr file) {
+    auto& s = shardFor(path);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    const auto it = s.index.find(path);
+    if (it != s.index.end())
+        eraseLocked(s, it->second);
+
+    while (s.lru.size() >= m_shardCapacity)
+        eraseLocked(s, std::prev(s.lru.end()));
+
+    s.lru.emplace_front(path, std::move(file));
+    s.index.emplace(path, s.lru.begin());
+}
+
+void fd_cache::erase(const std::string& path) {
+    auto& s = shardFor(path);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    const auto it = s.index.find(path);
+    if (it != s.index.end())
+        eraseLocked(s, it->second);
+}
+
+void fd_cache::clear() {
+    for (size_t i = 0; i < SHARDS_COUNT; ++i) {
+        auto& s = m_shards[i];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.index.clear();
+        s.lru.clear();
+    }
+}
+
+void fd_cache::eraseLocked(shard& s, lru_list::iterator it) {
+    s.index.erase(it->first);
+    s.lru.erase(it);
+}
+} // namespace http
@@ -0,0 +1,138 @@
+/*
+ * fd_cache.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef FD_CACHE_H
+#define FD_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <utility>
+
+namespace http {
+/**
+ * @brief Read-only descriptor of a regular file with its metadata.
+ * A file which can't be opened is represented by INVALID_FD, so failed
+ * lookups are cached as well. Object owns the descriptor and closes it on
+ * destruction.
+ */
+struct open_file {
+    static constexpr int INVALID_FD = -1;
+
+    /**
+     * @brief Open a file and check that it is a regular one.
+     *
+     * @param path - File path.
+     * @param expires - Moment the entry becomes stale, in metrics::now()
+     * units.
+     */
+    open_file(const std::string& path, uint64_t expires);
+    ~open_file();
+
+    open_file(const open_file&) = delete;
+    open_file& operator=(const open_file&) = delete;
+
+    bool exists() const noexcept {
+        return fd != INVALID_FD;
+    }
+
+    int fd = INVALID_FD;
+    /// File metadata at the moment of opening. Valid if the file exists.
+    struct stat stat;
+    /// Validators of the file, made once when it is opened.
+    std::string etag;
+    std::string lastModified;
+    /// Header lines with the validators.
+    std::string validators;
+    uint64_t expires;
+};
+
+/**
+ * @brief Shared cache of open file descriptors with LRU eviction.
+ * It saves open() and fstat() calls for files which are too large for
+ * file_cache or when it is disabled. Entries live at most for the validity
+ * period, then the file is opened again, so changes of the root directory
+ * are noticed. It has the same sharding and reference counting as
+ * file_cache: a reply being sent keeps its descriptor open after the entry
+ * is evicted.
+ */
+class fd_cache {
+    public:
+        using entry_ptr = std::shared_ptr<const open_file>;
+
+        /**
+         * @brief Construct a cache.
+         *
+         * @param capacity - Maximum count of entries.
+         * @param validity - Entry lifetime in nanoseconds.
+         */
+        fd_cache(size_t capacity, uint64_t validity);
+
+        fd_cache(const fd_cache&) = delete;
+        fd_cache& operator=(const fd_cache&) = delete;
+
+        /**
+         * @brief Find a file which is not stale and mark it as recently used.
+         *
+         * @param path - Resolved file path.
+         * @param now - Current moment in metrics::now() units.
+         *
+         * @return Open file, missing file entry or nullptr.
+         */
+        entry_ptr find(const std::string& path, uint64_t now);
+
+        /**
+         * @brief Insert or replace a file evicting least recently used ones.
+         *
+         * @param path - Resolved file path.
+         * @param file - Open file or missing file entry.
+         */
+        void insert(const std::string& path, entry_ptr file);
+
+        /**
+         * @brief Remove a file from the cache.
+         *
+         * @param path - Resolved file path.
+         */
+        void erase(const std::string& path);
+
+        /**
+         * @brief Remove all files from the cache.
+         */
+        void clear();
+
+        uint64_t validity() const noexcept {
+            return m_validity;
+        }
+
+    private:
+        using lru_list = std::list<std::pair<std::string, entry_ptr>>;
+
+        struct shard {
+            std::mutex mutex;
+            lru_list lru;
+            std::unordered_map<std::string, lru_list::iterator> index;
+        };
+
+        static constexpr size_t SHARDS_COUNT = 16;
+
+        shard& shardFor(const std::string& path);
+        static void eraseLocked(shard& s, lru_list::iterator it);
+
+    private:
+        size_t m_shardCapacity;
+        uint64_t m_validity;
+        std::unique_ptr<shard[]> m_shards;
+};
+} // namespace http
+
+#endif /* !FD_CACHE_H */
@@ -0,0 +1,76 @@
+/*
+ * file_cache.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "file_cache.h"
+
+#include <functional>
+#include <iterator>
+
+namespace http {
+file_cache::file_cache(size_t capacity)
+    : m_shardCapacity(capacity / SHARDS_COUNT)
+    , m_shards(new shard[SHARDS_COUNT])
+{}
+
+file_cache::shard& file_cache::shardFor(const std::string& path) {
+    return m_shards[std::hash<std::string>()(path) % SHARDS_COUNT];
+}
+
+file_cache::entry_ptr file_cache::find(const std::string& path) {
+    auto& s = shardFor(path);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    const auto it = s.index.find(path);
+    if (it == s.index.end())
+        return nullptr;
+
+    s.lru.splice(s.lru.begin(), s.lru, it->second);
+    return it->second->second;
+}
+
+void file_cache::insert(const std::string& path, entry_ptr file) {
+    const auto fileSize = file->memorySize();
+    if (fileSize > maxEntrySize())
+        return;
+
+    auto& s = shardFor(path);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    const auto it = s.index.find(path);
+    if (it != s.index.end())
+        eraseLocked(s, it->second);
+
+    while (!s.lru.empty() && s.size + fileSize > m_shardCapacity)
+        eraseLocked(s, std::prev(s.lru.end()));
+
+    s.lru.emplace_front(path, std::move(file));
+    s.index.emplace(path, s.lru.begin());
+    s.size += fileSize;
+}
+
+void file_cache::erase(const std::string& path) {
+    auto& s = shardFor(path);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    const auto it = s.index.find(path);
+    if (it != s.index.end())
+        eraseLocked(s, it->second);
+}
+
+void file_cache::clear() {
+    for (size_t i = 0; i < SHARDS_COUNT; ++i) {
+        auto& s = m_shards[i];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.index.clear();
+        s.lru.clear();
+        s.size = 0;
+    }
+}
+
+void file_cache::eraseLocked(shard& s, lru_list::iterator it) {
+    s.size -= it->second->memorySize();
+    s.index.erase(it->first);
+    s.lru.erase(it);
+}
+} // namespace http
@@ -0,0 +1,122 @@
+/*
+ * file_cache.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <utility>
+
+namespace http {
+/**
+ * @brief File contents with a ready to send reply head.
+ */
+struct cached_file {
+    /// Serialized status line and headers of 200 reply.
+    std::string head;
+    /// File contents.
+    std::string body;
+    /// File metadata at the moment of reading.
+    struct stat stat;
+    /// Validators of the cached contents.
+    std::string etag;
+    std::string lastModified;
+    /// Header lines with the validators.
+    std::string validators;
+
+    size_t memorySize() const noexcept {
+        return head.size() + body.size() + etag.size() + lastModified.size()
+             + validators.size() + sizeof(cached_file);
+    }
+};
+
+/**
+ * @brief Shared in-memory cache of files with LRU eviction.
+ * Cache is split into shards with a separate lock each, so workers rarely
+ * contend for a lock. Total memory of entries is kept within the budget.
+ * Entries are immutable and reference counted, so a reply being sent stays
+ * valid after the entry is evicted.
+ */
+class file_cache {
+    public:
+        using entry_ptr = std::shared_ptr<const cached_file>;
+
+        /**
+         * @brief Construct a cache.
+         *
+         * @param capacity - Memory budget in bytes.
+         */
+        explicit file_cache(size_t capacity);
+
+        file_cache(const file_cache&) = delete;
+        file_cache& operator=(const file_cache&) = delete;
+
+        /**
+         * @brief Find a file and mark it as recently used.
+         *
+         * @param path - Resolved file path.
+         *
+         * @return Cached file or nullptr.
+         */
+        entry_ptr find(const std::string& path);
+
+        /**
+         * @brief Insert or replace a file evicting least recently used ones.
+         * Files which do not fit into maxEntrySize() are not inserted.
+         *
+         * @param path - Resolved file path.
+         * @param file - File contents.
+         */
+        void insert(const std::string& path, entry_ptr file);
+
+        /**
+         * @brief Remove a file from the cache.
+         *
+         * @param path - Resolved file path.
+         */
+        void erase(const std::string& path);
+
+        /**
+         * @brief Remove all files from the cache.
+         */
+        void clear();
+
+        /**
+         * @brief Size of the largest file which is worth caching.
+         */
+        size_t maxEntrySize() const noexcept {
+            return m_shardCapacity / 2;
+        }
+
+    private:
+        using lru_list = std::list<std::pair<std::string, entry_ptr>>;
+
+        struct shard {
+            std::mutex mutex;
+            lru_list lru;
+            std::unordered_map<std::string, lru_list::iterator> index;
+            size_t size = 0;
+        };
+
+        static constexpr size_t SHARDS_COUNT = 16;
+
+        shard& shardFor(const std::string& path);
+        static void eraseLocked(shard& s, lru_list::iterator it);
+
+    private:
+        size_t m_shardCapacity;
+        std::unique_ptr<shard[]> m_shards;
+};
+} // namespace http
+
+#endif /* !FILE_CACHE_H */
@@ -0,0 +1,355 @@
+/*
+ * fuzz_parser.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+/*
+ * Fuzz target of request_parser and parseUri. The first input byte seeds
+ * the split of the rest into chunks, as if the request arrived in several
+ * reads. Every scanner implementation parses the chunks and its result and
+ * consumed length are compared with reference_parser, a copy of the
+ * original state machine which parses the whole input byte by byte; URIs
+ * of parsed requests are checked with parseUri. Any mismatch aborts, so it
+ * is reported as a crash.
+ * Built with -DHTTP_LIBFUZZER=ON it is a libFuzzer target. Otherwise it has
+ * its own main: it runs given files or the standard input once, which suits
+ * AFL and reproducing crashes, or mutates seeds for a given time and prints
+ * execs/sec as a JSON line. Requests of a bench corpus are run with every
+ * split before that, which is the parser_differential test.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "bench/corpus.h"
+#include "boost_parser/request.hpp"
+#include "boost_parser/request_parser.hpp"
+#include "boost_parser/request_view.hpp"
+#include "boost_parser/scanner.hpp"
+#include "common.h"
+#include "reference_parser.hpp"
+#include "request_handler.h"
+
+namespace {
+const char ROOT_DIR[] = "/root/";
+
+/// Compare optimized parsers with the reference one.
+bool differential = true;
+
+struct parse_result {
+    http::request_parser::result_type result;
+    size_t consumed;
+    http::request_view view;
+};
+
+void fail(const char* what, const char* data, size_t size) {
+    fprintf(stderr, "%s on input of %zu bytes:\n", what, size);
+    fwrite(data, 1, size, stderr);
+    fputc('\n', stderr);
+    abort();
+}
+
+/**
+ * @brief Parse input in chunks of 1-16 bytes chosen by a seed.
+ * Zero seed means the whole input at once.
+ */
+parse_result parse(const char* data, size_t size, unsigned seed) {
+    parse_result r;
+    http::request_parser parser;
+    auto chunks = seed;
+    auto it = data;
+    const auto end = data + size;
+    r.result = http::request_parser::indeterminate;
+    while (it != end && r.result == http::request_parser::indeterminate) {
+        auto chunkEnd = end;
+        if (seed) {
+            // Linear congruential generator, so a seed gives the same split
+            // on every run.
+            chunks = chunks * 1103515245u + 12345u;
+            chunkEnd = it + std::min<size_t>(end - it, 1 + (chunks >> 16) % 16);
+        }
+        const char* parsed;
+        std::tie(r.result, parsed) = parser.parse(r.view, it, chunkEnd);
+        it = parsed;
+        if (r.result == http::request_parser::indeterminate && it != chunkEnd)
+            fail("Parser stopped in the middle of a chunk", data, size);
+    }
+    r.consumed = it - data;
+    r.view.base = data;
+    return r;
+}
+
+/**
+ * @brief Parse the whole input with the reference parser.
+ */
+parse_result parseReference(const char* data, size_t size) {
+    parse_result r;
+    http::reference_parser parser;
+    const char* parsed;
+    std::tie(r.result, parsed) = parser.parse(r.view, data, data + size);
+    r.consumed = parsed - data;
+    r.view.base = data;
+    return r;
+}
+
+/// Offsets of empty slices are not defined.
+bool sameSlice(http::slice a, http::slice b) {
+    return a.length == b.length && (a.length == 0 || a.offset == b.offset);
+}
+
+bool sameResult(const parse_result& a, const parse_result& b) {
+    if (a.result != b.result || a.consumed != b.consumed)
+        return false;
+    if (a.result != http::request_parser::good)
+        return true;
+    if (!sameSlice(a.view.method, b.view.method)
+            || !sameSlice(a.view.uri, b.view.uri)
+            || a.view.http_version_major != b.view.http_version_major
+            || a.view.http_version_minor != b.view.http_version_minor
+            || a.view.header_count != b.view.header_count)
+        return false;
+    for (size_t i = 0; i < a.view.header_count; ++i) {
+        if (!sameSlice(a.view.headers[i].name, b.view.headers[i].name)
+                || !sameSlice(a.view.headers[i].value
+                            , b.view.headers[i].value))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Drop line breaks with the following whitespace from a folded
+ * header value. A view spans them, while a copy has only the parts.
+ */
+std::string unfold(const std::string& value) {
+    std::string result;
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] != '\r') {
+            result += value[i];
+            continue;
+        }
+        ++i;
+        while (i + 1 < value.size()
+                && (value[i + 1] == ' ' || value[i + 1] == '\t'))
+            ++i;
+    }
+    return result;
+}
+
+/**
+ * @brief Check that a request copied into strings matches its view.
+ */
+void checkCopy(const parse_result& reference, const char* data, size_t size) {
+    http::request_parser parser;
+    http::request request;
+    // Bytes are passed through a non-pointer iterator, so the generic
+    // byte by byte loop is used.
+    const std::string input(data, size);
+    const auto result = parser.parse(request, input.begin(), input.end());
+    const auto& view = reference.view;
+    bool same = std::get<0>(result) == reference.result
+             && static_cast<size_t>(std::get<1>(result) - input.begin())
+                == reference.consumed;
+    if (same && reference.result == http::request_parser::good) {
+        same = request.method == view.str(view.method)
+            && request.uri == view.str(view.uri)
+            && request.headers.size() == view.header_count;
+        for (size_t i = 0; same && i < view.header_count; ++i) {
+            same = request.headers[i].name == view.str(view.headers[i].name)
+                && request.headers[i].value
+                   == unfold(view.str(view.headers[i].value));
+        }
+    }
+    if (!same)
+        fail("Copying parser differs from the reference", data, size);
+}
+
+/**
+ * @brief Check that a URI is mapped to a normalized path inside the root.
+ */
+void checkUri(const parse_result& parsed, const char* data, size_t size) {
+    const auto& view = parsed.view;
+    std::string path = ROOT_DIR;
+    if (!http::parseUri(view.data(view.uri), view.uri.length, path))
+        return;
+    if (path.compare(0, sizeof(ROOT_DIR) - 1, ROOT_DIR) != 0
+            || path.find("..") != std::string::npos
+            || path.find("//") != std::string::npos
+            || path.find("/./") != std::string::npos
+            || path.back() == '/')
+        fail("URI is mapped outside of the root", data, size);
+}
+
+void runOne(const uint8_t* input, size_t size) {
+    if (size == 0)
+        return;
+    const auto seed = input[0];
+    const auto data = reinterpret_cast<const char*>(input + 1);
+    --size;
+
+    const auto best = http::scanner::best_isa();
+    if (!differential) {
+        const auto parsed = parse(data, size, seed);
+        if (parsed.result == http::request_parser::good)
+            checkUri(parsed, data, size);
+        return;
+    }
+
+    const auto reference = parseReference(data, size);
+    for (const auto isa: {http::scanner::none, http::scanner::scalar
+                        , http::scanner::sse42, http::scanner::avx2}) {
+        if (!http::scanner::use_isa(isa))
+            continue;
+        if (!sameResult(parse(data, size, seed), reference))
+            fail("Parser differs from the reference", data, size);
+    }
+    http::scanner::use_isa(best);
+
+    checkCopy(reference, data, size);
+    if (reference.result == http::request_parser::good)
+        checkUri(reference, data, size);
+}
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    runOne(data, size);
+    return 0;
+}
+
+#ifndef HTTP_LIBFUZZER
+namespace {
+const char* const SEEDS[] = {
+    "\x01GET / HTTP/1.1\r\nHost: localhost\r\n\r\n",
+    "\x07HEAD /index.html HTTP/1.0\r\nAccept: */*\r\n folded\r\n\r\n",
+    "\x02GET /a/./b//c?x=1 HTTP/1.1\r\nRange: bytes=0-1\r\n\r\nGET / H",
+    "\x05POST /form HTTP/1.1\r\nContent-Length: 0\r\n\r\n",
+};
+
+std::string readInput(std::istream& in) {
+    return std::string(std::istreambuf_iterator<char>(in)
+                     , std::istreambuf_iterator<char>());
+}
+
+void runString(const std::string& input) {
+    runOne(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+}
+
+/**
+ * @brief Change a few bytes of an input: replace, insert or erase them.
+ */
+void mutate(std::string& input, std::mt19937& random) {
+    static const char INTERESTING[] = "GETHAD /:\r\n \t.%?";
+    const auto count = 1 + random() % 4;
+    for (size_t i = 0; i < count && !input.empty(); ++i) {
+        const auto pos = random() % input.size();
+        const auto ch = random() % 2
+                      ? static_cast<char>(random())
+                      : INTERESTING[random() % (sizeof(INTERESTING) - 1)];
+        switch (random() % 3) {
+            case 0: input[pos] = ch; break;
+            case 1: input.insert(input.begin() + pos, ch); break;
+            default: input.erase(pos, 1); break;
+        }
+    }
+}
+
+void runMutations(const std::vector<std::string>& seeds, double duration) {
+    using clock = std::chrono::steady_clock;
+    std::mt19937 random(1);
+    size_t execs = 0;
+    const auto start = clock::now();
+    std::chrono::duration<double> elapsed{0};
+    std::string input;
+    while (elapsed.count() < duration) {
+        // The clock is read once per batch, so it is not measured.
+        for (int i = 0; i < 256; ++i) {
+            input = seeds[random() % seeds.size()];
+            mutate(input, random);
+            runString(input);
+        }
+        execs += 256;
+        elapsed = clock::now() - start;
+    }
+    static const char* const ISA_NAMES[] = {"none", "scalar", "sse42", "avx2"};
+    printf("{\"stage\":\"fuzz_parser\",\"differential\":%s,\"isa\":\"%s\""
+           ",\"execs\":%zu,\"seconds\":%.2f,\"execs_per_sec\":%.0f}\n"
+         , differential ? "true" : "false"
+         , ISA_NAMES[http::scanner::best_isa()], execs
+         , elapsed.count(), execs / elapsed.count());
+}
+}
+
+int main(int argc, char **argv) {
+    static const std::string optstring("t:nc:");
+
+    double duration = 0;
+    std::vector<corpus_entry> corpus;
+    int c{0};
+    while ( (c = getopt(argc, argv, optstring.c_str())) != -1) {
+        switch (c) {
+            case 't':
+                duration = getFromStr<double>(optarg);
+                break;
+            case 'n':
+                differential = false;
+                break;
+            case 'c': {
+                auto entries = readCorpus(optarg);
+                if (entries.empty())
+                    exit(EXIT_FAILURE);
+                corpus.insert(corpus.end(), entries.begin(), entries.end());
+                break;
+            }
+            default:
+                std::cerr << "Usage: " << argv[0]
+                          << " [-t <seconds>] [-n] [-c <corpus.jsonl>]"
+                          << " [<input file>...]" << std::endl;
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    std::vector<std::string> inputs;
+    for (auto i = optind; i < argc; ++i) {
+        std::ifstream file(argv[i], std::ios::binary);
+        if (!file) {
+            std::cerr << "Can't open input: " << argv[i] << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        inputs.push_back(readInput(file));
+    }
+
+    // The first byte chooses the split, so every split is tried.
+    for (const auto& entry: corpus) {
+        for (unsigned split = 0; split <= UINT8_MAX; ++split)
+            runString(static_cast<char>(split) + entry.request);
+    }
+
+    if (duration > 0) {
+        for (const auto seed: SEEDS)
+            inputs.push_back(seed);
+        for (const auto& entry: corpus)
+            inputs.push_back('\x01' + entry.request);
+        runMutations(inputs, duration);
+        return 0;
+    }
+
+    if (!corpus.empty() && inputs.empty())
+        return 0;
+    if (inputs.empty())
+        inputs.push_back(readInput(std::cin));
+    for (const auto& input: inputs)
+        runString(input);
+    return 0;
+}
+#endif
@@ -0,0 +1,362 @@
+//
+// reference_parser.cpp
+// ~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2003-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "reference_parser.hpp"
+
+namespace http {
+
+namespace {
+
+void append(slice& s, std::size_t pos, char input)
+{
+  (void)input;
+  if (s.length == 0)
+    s.offset = pos;
+  // A folded header value spans the line break between its parts.
+  s.length = pos - s.offset + 1;
+}
+
+bool has_headers(const request_view& req)
+{
+  return req.header_count != 0;
+}
+
+bool add_header(request_view& req)
+{
+  if (req.header_count == request_view::max_headers)
+    return false;
+  req.headers[req.header_count++] = header_view();
+  return true;
+}
+
+header_view& last_header(request_view& req)
+{
+  return req.headers[req.header_count - 1];
+}
+
+} // namespace
+
+reference_parser::reference_parser()
+  : state_(method_start),
+    pos_(0)
+{
+}
+
+void reference_parser::reset()
+{
+  state_ = method_start;
+  pos_ = 0;
+}
+
+std::tuple<request_parser::result_type, const char*> reference_parser::parse(
+    request_view& req, const char* begin, const char* end)
+{
+  while (begin != end)
+  {
+    request_parser::result_type result = consume(req, *begin++);
+    ++pos_;
+    if (result == request_parser::good || result == request_parser::bad)
+      return std::make_tuple(result, begin);
+  }
+  return std::make_tuple(request_parser::indeterminate, begin);
+}
+
+request_parser::result_type reference_parser::consume(request_view& req,
+    char input)
+{
+  switch (state_)
+  {
+  case method_start:
+    if (!is_char(input) || is_ctl(input) || is_tspecial(input))
+    {
+      return request_parser::bad;
+    }
+    else
+    {
+      state_ = method;
+      append(req.method, pos_, input);
+      return request_parser::indeterminate;
+    }
+  case method:
+    if (input == ' ')
+    {
+      state_ = uri;
+      return request_parser::indeterminate;
+    }
+    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
+    {
+      return request_parser::bad;
+    }
+    else
+    {
+      append(req.method, pos_, input);
+      return request_parser::indeterminate;
+    }
+  case uri:
+    if (input == ' ')
+    {
+      state_ = http_version_h;
+      return request_parser::indeterminate;
+    }
+    else if (is_ctl(input))
+    {
+      return request_parser::bad;
+    }
+    else
+    {
+      append(req.uri, pos_, input);
+      return request_parser::indeterminate;
+    }
+  case http_version_h:
+    if (input == 'H')
+    {
+      state_ = http_version_t_1;
+      return request_parser::indeterminate;
+    }
+    else
+    {
+      return request_parser::bad;
+    }
+  case http_version_t_1:
+    if (input == 'T')
+    {
+      state_ = http_version_t_2;
+      return request_parser::indeterminate;
+    }
+    else
+    {
+      return request_parser::bad;
+    }
+  case http_version_t_2:
+    if (input == 'T')
+    {
+      state_ = http_version_p;
+      return request_parser::indeterminate;
+    }
+    else
+    {
+      return request_parser::bad;
+    }
+  case http_version_p:
+    if (input == 'P')
+    {
+      state_ = http_version_slash;
+      return request_parser::indeterminate;
+    }
+    else
+    {
+      return request_parser::bad;
+    }
+  case http_version_slash:
+    if (input == '/')
+    {
+      req.http_version_major = 0;
+      req.http_version_minor = 0;
+      state_ = http_version_major_start;
+      return request_parser::indeterminate;
+    }
+    else
+    {
+      return request_parser::bad;
+    }
+  case http_version_major_start:
+    if (is_digit(input))
+    {
+      req.http_version_major = req.http_version_major * 10 + input - '0';
+      state_ = http_version_major;
+      return request_parser::indeterminate;
+    }
+    else
+    {
+      return request_parser::bad;
+    }
+  case http_version_major:
+    if (input == '.')
+    {
+      state_ = http_version_minor_start;
+      return request_parser::indeterminate;
+    }
+    else if (is_digit(input))
+    {
+      req.http_version_major = req.http_version_major * 10 + input - '0';
+      return request_parser::indeterminate;
+    }
+    else
+    {
+      return request_parser::bad;
+    }
+  case http_version_minor_start:
+    if (is_digit(input))
+    {
+      req.http_version_minor = req.http_version_minor * 10 + input - '0';
+      state_ = http_version_minor;
+      return request_parser::indeterminate;
+    }
+    else
+    {
+      return request_parser::bad;
+    }
+  case http_version_minor:
+    if (input == '\r')
+    {
+      state_ = expecting_newline_1;
+      return request_parser::indeterminate;
+    }
+    else if (is_digit(input))
+    {
+      req.http_version_minor = req.http_version_minor * 10 + input - '0';
+      return request_parser::indeterminate;
+    }
+    else
+    {
+      return request_parser::bad;
+    }
+  case expecting_newline_1:
+    if (input == '\n')
+    {
+      state_ = header_line_start;
+      return request_parser::indeterminate;
+    }
+    else
+    {
+      return request_parser::bad;
+    }
+  case header_line_start:
+    if (input == '\r')
+    {
+      state_ = expecting_newline_3;
+      return request_parser::indeterminate;
+    }
+    else if (has_headers(req) && (input == ' ' || input == '\t'))
+    {
+      state_ = header_lws;
+      return request_parser::indeterminate;
+    }
+    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
+    {
+      return request_parser::bad;
+    }
+    else if (!add_header(req))
+    {
+      return request_parser::bad;
+    }
+    else
+    {
+      append(last_header(req).name, pos_, input);
+      state_ = header_name;
+      return request_parser::indeterminate;
+    }
+  case header_lws:
+    if (input == '\r')
+    {
+      state_ = expecting_newline_2;
+      return request_parser::indeterminate;
+    }
+    else if (input == ' ' || input == '\t')
+    {
+      return request_parser::indeterminate;
+    }
+    else if (is_ctl(input))
+    {
+      return request_parser::bad;
+    }
+    else
+    {
+      state_ = header_value;
+      append(last_header(req).value, pos_, input);
+      return request_parser::indeterminate;
+    }
+  case header_name:
+    if (input == ':')
+    {
+      state_ = space_before_header_value;
+      return request_parser::indeterminate;
+    }
+    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
+    {
+      return request_parser::bad;
+    }
+    else
+    {
+      append(last_header(req).name, pos_, input);
+      return request_parser::indeterminate;
+    }
+  case space_before_header_value:
+    if (input == ' ')
+    {
+      state_ = header_value;
+      return request_parser::indeterminate;
+    }
+    else
+    {
+      return request_parser::bad;
+    }
+  case header_value:
+    if (input == '\r')
+    {
+      state_ = expecting_newline_2;
+      return request_parser::indeterminate;
+    }
+    else if (is_ctl(input))
+    {
+      return request_parser::bad;
+    }
+    else
+    {
+      append(last_header(req).value, pos_, input);
+      return request_parser::indeterminate;
+    }
+  case expecting_newline_2:
+    if (input == '\n')
+    {
+      state_ = header_line_start;
+      return request_parser::indeterminate;
+    }
+    else
+    {
+      return request_parser::bad;
+    }
+  case expecting_newline_3:
+    return (input == '\n') ? request_parser::good : request_parser::bad;
+  default:
+    return request_parser::bad;
+  }
+}
+
+bool reference_parser::is_char(int c)
+{
+  return c >= 0 && c <= 127;
+}
+
+bool reference_parser::is_ctl(int c)
+{
+  return (c >= 0 && c <= 31) || (c == 127);
+}
+
+bool reference_parser::is_tspecial(int c)
+{
+  switch (c)
+  {
+  case '(': case ')': case '<': case '>': case '@':
+  case ',': case ';': case ':': case '\\': case '"':
+  case '/': case '[': case ']': case '?': case '=':
+  case '{': case '}': case ' ': case '\t':
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool reference_parser::is_digit(int c)
+{
+  return c >= '0' && c <= '9';
+}
+
+} // namespace http
@@ -0,0 +1,86 @@
+//
+// reference_parser.hpp
+// ~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2003-2013 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP_REFERENCE_PARSER_HPP
+#define HTTP_REFERENCE_PARSER_HPP
+
+#include <cstddef>
+#include <tuple>
+
+#include "boost_parser/request_parser.hpp"
+#include "boost_parser/request_view.hpp"
+
+namespace http {
+
+/// Copy of the request parser before byte classes, method literals and
+/// scanners were added: the plain state machine which consumes one byte at
+/// a time. It shares no code with request_parser, so fuzz_parser uses it
+/// as the oracle. Do not optimize it.
+class reference_parser
+{
+public:
+  /// Construct ready to parse the request method.
+  reference_parser();
+
+  /// Reset to initial parser state.
+  void reset();
+
+  /// Parse some data like request_parser::parse().
+  std::tuple<request_parser::result_type, const char*> parse(
+      request_view& req, const char* begin, const char* end);
+
+private:
+  /// Handle the next character of input.
+  request_parser::result_type consume(request_view& req, char input);
+
+  /// Check if a byte is an HTTP character.
+  static bool is_char(int c);
+
+  /// Check if a byte is an HTTP control character.
+  static bool is_ctl(int c);
+
+  /// Check if a byte is defined as an HTTP tspecial character.
+  static bool is_tspecial(int c);
+
+  /// Check if a byte is a digit.
+  static bool is_digit(int c);
+
+  /// The current state of the parser.
+  enum state
+  {
+    method_start,
+    method,
+    uri,
+    http_version_h,
+    http_version_t_1,
+    http_version_t_2,
+    http_version_p,
+    http_version_slash,
+    http_version_major_start,
+    http_version_major,
+    http_version_minor_start,
+    http_version_minor,
+    expecting_newline_1,
+    header_line_start,
+    header_lws,
+    header_name,
+    space_before_header_value,
+    header_value,
+    expecting_newline_2,
+    expecting_newline_3
+  } state_;
+
+  /// Offset of the next input byte from the beginning of the request.
+  std::size_t pos_;
+};
+
+} // namespace http
+
+#endif // HTTP_REFERENCE_PARSER_HPP
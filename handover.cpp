@@ -0,0 +1,181 @@
+/*
+ * handover.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "handover.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace {
+/// Sockets passed with one message, SCM_RIGHTS takes up to 253.
+constexpr size_t BATCH_SIZE = 64;
+/// Seconds a new process waits for the sockets.
+constexpr time_t RECEIVE_TIMEOUT = 10;
+
+/**
+ * @brief Control buffer for BATCH_SIZE descriptors, aligned for cmsghdr.
+ */
+union control_buffer {
+    char data[CMSG_SPACE(sizeof(int) * BATCH_SIZE)];
+    cmsghdr align;
+};
+}
+
+namespace http {
+pid_t spawnSuccessor(const std::vector<std::string>& command, int& channel) {
+    if (command.empty())
+        throw std::runtime_error("No command to restart the server");
+
+    int ends[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, ends) < 0)
+        throw std::runtime_error("Can't create a handover channel");
+
+    // Everything is prepared before fork(): only async-signal-safe calls
+    // are allowed in the child of a multithreaded process.
+    std::vector<char*> argv;
+    for (const auto& arg: command)
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    const std::string prefix = std::string(HANDOVER_ENV) + '=';
+    const auto variable = prefix + std::to_string(ends[1]);
+    std::vector<char*> envp;
+    for (auto it = environ; *it; ++it) {
+        if (strncmp(*it, prefix.c_str(), prefix.size()) != 0)
+            envp.push_back(*it);
+    }
+    envp.push_back(const_cast<char*>(variable.c_str()));
+    envp.push_back(nullptr);
+
+    const auto pid = fork();
+    if (pid == 0) {
+        // The other end is close-on-exec, this one is inherited.
+        fcntl(ends[1], F_SETFD, 0);
+        execvpe(argv[0], argv.data(), envp.data());
+        _exit(127);
+    }
+    close(ends[1]);
+    if (pid < 0) {
+        close(ends[0]);
+        throw std::runtime_error("Can't start a new server process");
+    }
+    channel = ends[0];
+    return pid;
+}
+
+void sendSockets(int channel, const std::vector<int>& sockets) {
+    size_t sent = 0;
+    do {
+        const auto count = std::min(sockets.size() - sent, BATCH_SIZE);
+        // Every message carries the count of sockets left after it.
+        uint32_t left = sockets.size() - sent - count;
+        iovec iov = {&left, sizeof(left)};
+        control_buffer control;
+        msghdr message{};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        if (count > 0) {
+            message.msg_control = control.data;
+            message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+            auto header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+            std::copy(sockets.begin() + sent, sockets.begin() + sent + count
+                    , reinterpret_cast<int*>(CMSG_DATA(header)));
+        }
+        ssize_t result;
+        do {
+            result = sendmsg(channel, &message, MSG_NOSIGNAL);
+        } while (result < 0 && errno == EINTR);
+        if (result < 0)
+            throw std::runtime_error("Can't pass listening sockets");
+        sent += count;
+    } while (sent < sockets.size());
+}
+
+bool waitReady(int channel, unsigned timeout) noexcept {
+    pollfd fd = {channel, POLLIN, 0};
+    int result;
+    do {
+        result = poll(&fd, 1, timeout);
+    } while (result < 0 && errno == EINTR);
+    if (result <= 0)
+        return false;
+    char ready = 0;
+    // A process which exits before it is ready closes the channel.
+    return read(channel, &ready, sizeof(ready)) == sizeof(ready);
+}
+
+int takeHandoverChannel() noexcept {
+    const auto value = getenv(HANDOVER_ENV);
+    if (!value)
+        return -1;
+    char* end;
+    const auto channel = strtol(value, &end, 10);
+    unsetenv(HANDOVER_ENV);
+    if (*end != '\0' || channel < 0)
+        return -1;
+    // The channel is not passed to processes started by this one.
+    fcntl(channel, F_SETFD, FD_CLOEXEC);
+    return static_cast<int>(channel);
+}
+
+std::vector<int> receiveSockets(int channel) {
+    const timeval timeout = {RECEIVE_TIMEOUT, 0};
+    setsockopt(channel, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::vector<int> sockets;
+    uint32_t left;
+    do {
+        iovec iov = {&left, sizeof(left)};
+        control_buffer control;
+        msghdr message{};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data;
+        message.msg_controllen = sizeof(control.data);
+        ssize_t result;
+        do {
+            result = recvmsg(channel, &message, MSG_CMSG_CLOEXEC);
+        } while (result < 0 && errno == EINTR);
+        if (result != sizeof(left) || (message.msg_flags & MSG_CTRUNC)) {
+            for (const auto socket: sockets)
+                close(socket);
+            throw std::runtime_error("Can't receive listening sockets");
+        }
+        for (auto header = CMSG_FIRSTHDR(&message); header
+                ; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level != SOL_SOCKET
+                    || header->cmsg_type != SCM_RIGHTS)
+                continue;
+            const auto data = reinterpret_cast<const int*>(CMSG_DATA(header));
+            sockets.insert(sockets.end(), data, data
+                           + (header->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        }
+    } while (left > 0);
+    return sockets;
+}
+
+void notifyReady(int channel) noexcept {
+    const char ready = 1;
+    const auto result = write(channel, &ready, sizeof(ready));
+    static_cast<void>(result);
+    close(channel);
+}
+} // namespace http
@@ -0,0 +1,78 @@
+/*
+ * handover.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef HANDOVER_H
+#define HANDOVER_H
+
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace http {
+/*
+ * Restart without a rebind gap. The running server starts a new process
+ * with one end of a Unix socket pair named by the HANDOVER_ENV variable and
+ * passes its listening sockets over it with SCM_RIGHTS. Both processes share
+ * the same sockets, so clients waiting in the listen backlog are accepted by
+ * the new process. When the new server is ready it sends one byte and the
+ * old one drains its connections.
+ */
+
+/// Environment variable with the channel descriptor of a new process.
+constexpr char HANDOVER_ENV[] = "HTTP_HANDOVER_FD";
+
+/**
+ * @brief Start a new server process with a handover channel.
+ *
+ * @param command - Program and its arguments. The program is looked up in
+ * PATH if it has no slash, so a replaced binary is started.
+ * @param channel - Output end of the channel of this process.
+ *
+ * @return Process id.
+ */
+pid_t spawnSuccessor(const std::vector<std::string>& command, int& channel)
+    noexcept(false);
+
+/**
+ * @brief Pass listening sockets over a channel.
+ */
+void sendSockets(int channel, const std::vector<int>& sockets)
+    noexcept(false);
+
+/**
+ * @brief Wait until a new server is ready to take over.
+ *
+ * @param channel - Channel of spawnSuccessor().
+ * @param timeout - Time to wait in milliseconds.
+ *
+ * @return false if the new process failed or did not answer in time.
+ */
+bool waitReady(int channel, unsigned timeout) noexcept;
+
+/**
+ * @brief Get the channel given to this process and clear HANDOVER_ENV,
+ * so processes started later do not inherit it.
+ * It is not thread-safe, call it before threads are started.
+ *
+ * @return Channel or -1 if the process is not a restarted server.
+ */
+int takeHandoverChannel() noexcept;
+
+/**
+ * @brief Receive listening sockets sent by sendSockets().
+ * Received descriptors are close-on-exec.
+ */
+std::vector<int> receiveSockets(int channel) noexcept(false);
+
+/**
+ * @brief Tell the old server that this one accepts clients and close the
+ * channel.
+ */
+void notifyReady(int channel) noexcept;
+} // namespace http
+
+#endif /* !HANDOVER_H */
@@ -0,0 +1,41 @@
+/*
+ * io_loop.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef IO_LOOP_H
+#define IO_LOOP_H
+
+namespace http {
+/**
+ * @brief I/O engine of one worker thread.
+ * It accepts clients from a listening socket and serves them until stopped.
+ */
+class io_loop {
+    public:
+        virtual ~io_loop() = default;
+
+        /**
+         * @brief Serve clients until stop() is called.
+         */
+        virtual void run() = 0;
+
+        /**
+         * @brief Ask the loop to return from run().
+         * It is safe to call from any thread and from a signal handler.
+         */
+        virtual void stop() noexcept = 0;
+
+        /**
+         * @brief Stop accepting clients, finish requests in progress and
+         * return from run() when all connections are closed.
+         * Idle connections are closed at once, the rest are closed after
+         * their next reply. It is safe to call from any thread.
+         */
+        virtual void drain() noexcept = 0;
+};
+} // namespace http
+
+#endif /* !IO_LOOP_H */
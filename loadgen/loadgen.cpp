@@ -0,0 +1,454 @@
+/*
+ * loadgen.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+/*
+ * End-to-end load benchmark. It starts http::server on loopback against
+ * a generated root directory and drives it over keep-alive connections.
+ * Without a rate the load is closed-loop: every connection sends the next
+ * request as soon as the previous reply arrives. With a rate the load is
+ * open-loop: requests are scheduled at fixed intervals and latency is
+ * measured from the scheduled time, so stalls of the server are not hidden
+ * by the generator waiting for it (coordinated omission). Several I/O
+ * engines may be given, the same load is run against each of them in turn.
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "common.h"
+#include "server.h"
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock_type::now().time_since_epoch()).count();
+}
+
+struct file_class {
+    size_t size;
+    unsigned weight;
+};
+
+struct options {
+    unsigned connections = 64;
+    double duration = 5;
+    double rate = 0;
+    std::vector<file_class> mix = { {1024, 70}, {16384, 25}, {1048576, 5} };
+    http::server_options server;
+    std::vector<http::io_engine> engines = {http::io_engine::epoll};
+};
+
+/// Files of one size class in the generated root directory.
+constexpr unsigned FILES_PER_CLASS = 8;
+
+std::vector<file_class> parseMix(const std::string& s) {
+    std::vector<file_class> mix;
+    std::istringstream is(s);
+    std::string item;
+    while (std::getline(is, item, ',')) {
+        const auto colon = item.find(':');
+        file_class c;
+        c.size = getFromStr<size_t>(item.substr(0, colon));
+        c.weight = colon == std::string::npos
+                 ? 1 : getFromStr<unsigned>(item.substr(colon + 1));
+        mix.push_back(c);
+    }
+    return mix;
+}
+
+std::vector<http::io_engine> parseEngines(const std::string& s) {
+    std::vector<http::io_engine> engines;
+    std::istringstream is(s);
+    std::string item;
+    while (std::getline(is, item, ',')) {
+        http::io_engine engine;
+        if (!http::parseEngine(item, engine))
+            throw std::invalid_argument("Unknown I/O engine \"" + item + '"');
+        engines.push_back(engine);
+    }
+    return engines;
+}
+
+std::string fileName(size_t size, unsigned index) {
+    return "f" + std::to_string(size) + "_" + std::to_string(index) + ".bin";
+}
+
+std::string makeRootDir(const std::vector<file_class>& mix) {
+    char dirTemplate[] = "/tmp/loadgen.XXXXXX";
+    if (!mkdtemp(dirTemplate))
+        throw std::runtime_error("Can't create root directory");
+
+    const std::string dir = std::string(dirTemplate) + '/';
+    for (const auto& c: mix) {
+        const std::string contents(c.size, 'x');
+        for (unsigned i = 0; i < FILES_PER_CLASS; ++i) {
+            std::ofstream file(dir + fileName(c.size, i), std::ios::binary);
+            file << contents;
+        }
+    }
+    return dir;
+}
+
+void removeRootDir(const std::string& dir, const std::vector<file_class>& mix) {
+    for (const auto& c: mix) {
+        for (unsigned i = 0; i < FILES_PER_CLASS; ++i)
+            unlink((dir + fileName(c.size, i)).c_str());
+    }
+    rmdir(dir.c_str());
+}
+
+short freePort() {
+    const auto sock = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    // Port is a short in http::server, so pick one below 32768.
+    for (int port = 20000 + getpid() % 10000; port < 32768; ++port) {
+        addr.sin_port = htons(port);
+        if (bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+            close(sock);
+            return static_cast<short>(port);
+        }
+    }
+    close(sock);
+    throw std::runtime_error("Can't find a free port");
+}
+
+/// Client side of one keep-alive connection.
+struct client {
+    int socket = -1;
+    bool busy = false;
+    std::string request;
+    size_t requestSent = 0;
+    std::string head;
+    size_t bodyLeft = 0;
+    bool inBody = false;
+    uint64_t intendedNs = 0;
+};
+
+class generator {
+    public:
+        generator(const options& opts, short port)
+            : m_opts(opts)
+            , m_port(port)
+            , m_clients(opts.connections)
+            , m_random(42)
+        {
+            m_epoll = callStdlibFunc([] {
+                throw std::runtime_error("Can't create epoll");
+            }, epoll_create1, 0);
+            std::vector<unsigned> weights;
+            for (const auto& c: opts.mix)
+                weights.push_back(c.weight);
+            m_pick = std::discrete_distribution<unsigned>(weights.begin()
+                                                        , weights.end());
+            for (size_t i = 0; i < m_clients.size(); ++i)
+                connectClient(i);
+        }
+
+        ~generator() {
+            for (auto& c: m_clients) {
+                if (c.socket >= 0)
+                    close(c.socket);
+            }
+            close(m_epoll);
+        }
+
+        void run();
+        void report(http::io_engine engine) const;
+
+    private:
+        void connectClient(size_t index);
+        void send(size_t index, uint64_t intendedNs);
+        void onEvent(size_t index);
+        void fail(size_t index);
+        void complete(size_t index);
+
+    private:
+        const options& m_opts;
+        short m_port;
+        int m_epoll = -1;
+        std::vector<client> m_clients;
+        std::discrete_distribution<unsigned> m_pick;
+        std::mt19937 m_random;
+        std::deque<size_t> m_idle;
+        std::vector<uint64_t> m_latencies;
+        uint64_t m_bytes = 0;
+        uint64_t m_errors = 0;
+        /// Maximum count of scheduled requests waiting for a connection.
+        size_t m_maxBacklog = 0;
+        double m_elapsed = 0;
+};
+
+void generator::connectClient(size_t index) {
+    auto& c = m_clients[index];
+    if (c.socket >= 0)
+        close(c.socket);
+    c = client();
+    c.socket = callStdlibFunc([] {
+        throw std::runtime_error("Can't create socket");
+    }, socket, AF_INET, SOCK_STREAM, 0);
+
+    sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(m_port);
+    callStdlibFunc([] {
+        throw std::runtime_error("Can't connect to the server");
+    }, connect, c.socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+
+    const int enable = 1;
+    setsockopt(c.socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    fcntl(c.socket, F_SETFL, fcntl(c.socket, F_GETFL, 0) | O_NONBLOCK);
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    event.data.u64 = index;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, c.socket, &event);
+    m_idle.push_back(index);
+}
+
+void generator::send(size_t index, uint64_t intendedNs) {
+    auto& c = m_clients[index];
+    const auto& fileClass = m_opts.mix[m_pick(m_random)];
+    const auto file = fileName(fileClass.size
+                             , m_random() % FILES_PER_CLASS);
+    c.request = "GET /" + file + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    c.requestSent = 0;
+    c.head.clear();
+    c.inBody = false;
+    c.busy = true;
+    c.intendedNs = intendedNs;
+    onEvent(index);
+}
+
+void generator::onEvent(size_t index) {
+    auto& c = m_clients[index];
+    while (c.busy && c.requestSent < c.request.size()) {
+        const auto sent = ::send(c.socket, c.request.data() + c.requestSent
+                               , c.request.size() - c.requestSent
+                               , MSG_NOSIGNAL);
+        if (sent < 0 && errno == EAGAIN)
+            return;
+        if (sent <= 0)
+            return fail(index);
+        c.requestSent += sent;
+    }
+
+    char buffer[65536];
+    while (c.busy) {
+        const auto bytesRead = read(c.socket, buffer, sizeof(buffer));
+        if (bytesRead < 0 && errno == EAGAIN)
+            return;
+        if (bytesRead <= 0)
+            return fail(index);
+
+        m_bytes += bytesRead;
+        size_t bodyBytes = bytesRead;
+        if (!c.inBody) {
+            c.head.append(buffer, bytesRead);
+            const auto headEnd = c.head.find("\r\n\r\n");
+            if (headEnd == std::string::npos)
+                continue;
+
+            static const std::string LENGTH = "content-length:";
+            std::string lowerHead = c.head.substr(0, headEnd);
+            std::transform(lowerHead.begin(), lowerHead.end()
+                         , lowerHead.begin(), ::tolower);
+            const auto lengthPos = lowerHead.find(LENGTH);
+            if (lengthPos == std::string::npos
+                    || c.head.compare(0, 12, "HTTP/1.1 200") != 0)
+                return fail(index);
+            c.bodyLeft = getFromStr<size_t>(
+                    c.head.substr(lengthPos + LENGTH.size()));
+            c.inBody = true;
+            bodyBytes = c.head.size() - headEnd - 4;
+        }
+
+        if (bodyBytes > c.bodyLeft)
+            return fail(index);
+        c.bodyLeft -= bodyBytes;
+        if (c.bodyLeft == 0)
+            complete(index);
+    }
+}
+
+void generator::fail(size_t index) {
+    ++m_errors;
+    connectClient(index);
+}
+
+void generator::complete(size_t index) {
+    auto& c = m_clients[index];
+    c.busy = false;
+    m_latencies.push_back(nowNs() - c.intendedNs);
+    m_idle.push_back(index);
+}
+
+void generator::run() {
+    const auto start = nowNs();
+    const auto end = start + static_cast<uint64_t>(m_opts.duration * 1e9);
+    const auto interval = m_opts.rate > 0
+                        ? static_cast<uint64_t>(1e9 / m_opts.rate) : 0;
+    uint64_t nextSend = start;
+    std::deque<uint64_t> scheduled;
+
+    epoll_event events[256];
+    while (true) {
+        auto now = nowNs();
+        if (interval) {
+            for (; nextSend <= now && nextSend < end; nextSend += interval)
+                scheduled.push_back(nextSend);
+            m_maxBacklog = std::max(m_maxBacklog, scheduled.size());
+            while (!scheduled.empty() && !m_idle.empty()) {
+                const auto index = m_idle.front();
+                m_idle.pop_front();
+                send(index, scheduled.front());
+                scheduled.pop_front();
+            }
+        }
+        else if (now < end) {
+            while (!m_idle.empty()) {
+                const auto index = m_idle.front();
+                m_idle.pop_front();
+                send(index, nowNs());
+            }
+        }
+
+        now = nowNs();
+        const auto inFlight = m_clients.size() - m_idle.size();
+        if (now >= end && scheduled.empty() && inFlight == 0)
+            break;
+        // Give stalled replies a few seconds after the end.
+        if (now >= end + 5000000000ULL)
+            break;
+
+        int timeoutMs = 100;
+        if (interval && nextSend < end)
+            timeoutMs = nextSend > now ? (nextSend - now) / 1000000 : 0;
+        const auto count = epoll_wait(m_epoll, events, 256, timeoutMs);
+        for (int i = 0; i < count; ++i) {
+            const auto index = events[i].data.u64;
+            if (m_clients[index].busy)
+                onEvent(index);
+        }
+    }
+    m_elapsed = (nowNs() - start) / 1e9;
+}
+
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    const auto index = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+void generator::report(http::io_engine engine) const {
+    auto sorted = m_latencies;
+    std::sort(sorted.begin(), sorted.end());
+    printf("{\"engine\":\"%s\",\"connections\":%u,\"rate\":%.0f,\"duration_sec\":%.2f"
+           ",\"workers\":%u,\"requests\":%zu,\"errors\":%llu"
+           ",\"max_backlog\":%zu"
+           ",\"throughput_rps\":%.0f,\"throughput_bytes_per_sec\":%.0f"
+           ",\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f"
+           ",\"max_us\":%.1f}\n"
+         , http::engineName(engine)
+         , m_opts.connections, m_opts.rate, m_elapsed, m_opts.server.workers
+         , sorted.size(), static_cast<unsigned long long>(m_errors)
+         , m_maxBacklog
+         , sorted.size() / m_elapsed, m_bytes / m_elapsed
+         , percentile(sorted, 0.5) / 1e3, percentile(sorted, 0.99) / 1e3
+         , percentile(sorted, 0.999) / 1e3
+         , (sorted.empty() ? 0 : sorted.back()) / 1e3);
+}
+}
+
+int main(int argc, char **argv) {
+    static const std::string optstring("c:d:r:s:w:C:e:");
+
+    options opts;
+    int c{0};
+    while ( (c = getopt(argc, argv, optstring.c_str())) != -1) {
+        switch (c) {
+            case 'c':
+                opts.connections = getFromStr<unsigned>(optarg);
+                break;
+            case 'd':
+                opts.duration = getFromStr<double>(optarg);
+                break;
+            case 'r':
+                opts.rate = getFromStr<double>(optarg);
+                break;
+            case 's':
+                opts.mix = parseMix(optarg);
+                break;
+            case 'w':
+                opts.server.workers = getFromStr<unsigned>(optarg);
+                break;
+            case 'C':
+                opts.server.cacheSize = getFromStr<size_t>(optarg);
+                break;
+            case 'e':
+                opts.engines = parseEngines(optarg);
+                break;
+            default:
+                std::cerr << "Usage: " << argv[0]
+                          << " [-c <connections>] [-d <seconds>]"
+                          << " [-r <requests per second>]"
+                          << " [-s <size:weight,...>] [-w <server workers>]"
+                          << " [-C <server cache bytes>]"
+                          << " [-e <engine,...>]" << std::endl;
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (opts.mix.empty() || opts.connections == 0 || opts.engines.empty()) {
+        std::cerr << "Empty file size mix, no connections or no engines"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    try {
+        const auto rootDir = makeRootDir(opts.mix);
+        for (const auto engine: opts.engines) {
+            auto serverOptions = opts.server;
+            serverOptions.engine = engine;
+            const auto port = freePort();
+            http::server server("127.0.0.1", port, rootDir, serverOptions);
+            generator gen(opts, port);
+            gen.run();
+            // Report the engine actually used, uring may fall back to epoll.
+            gen.report(server.engine());
+        }
+        removeRootDir(rootDir, opts.mix);
+    } catch (std::exception& ex) {
+        fprintf(stderr, "Exception: %s\n", ex.what());
+        exit(EXIT_FAILURE);
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * logdecode.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+/*
+ * Offline decoder of binary server logs. It reads a log written with
+ * "final -b" from a file or the standard input and prints it as text lines.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "logger.h"
+
+namespace {
+bool decode(std::istream& in, std::ostream& out) {
+    http::log_file_header header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+            || !std::equal(header.magic, header.magic + sizeof(header.magic)
+                         , http::log_file_header::MAGIC)) {
+        std::cerr << "Not a binary server log" << std::endl;
+        return false;
+    }
+    if (header.version != http::log_file_header::VERSION
+            || header.recordSize != sizeof(http::log_record)) {
+        std::cerr << "Unsupported log version " << header.version
+                  << " with record size " << header.recordSize << std::endl;
+        return false;
+    }
+
+    http::log_record record;
+    std::string line;
+    while (in.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+        line.clear();
+        http::formatLogRecord(record, line);
+        out << line;
+    }
+    if (in.gcount() != 0) {
+        std::cerr << "Log ends with a truncated record" << std::endl;
+        return false;
+    }
+    return true;
+}
+}
+
+int main(int argc, char **argv) {
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-' && argv[1][1] != '\0')) {
+        std::cerr << "Usage: " << argv[0] << " [<log file>]" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (argc == 1 || std::string(argv[1]) == "-")
+        return decode(std::cin, std::cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "Can't open \"" << argv[1] << '\"' << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return decode(in, std::cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
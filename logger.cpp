@@ -0,0 +1,300 @@
+/*
+ * logger.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "logger.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdarg>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+/**
+ * @brief Single producer single consumer ring of log records.
+ * Owner thread is the producer, the writer thread is the consumer.
+ */
+struct log_ring {
+    static constexpr uint64_t CAPACITY = 1024;
+
+    /// Count of written records. Updated by the producer.
+    std::atomic<uint64_t> head{0};
+    /// Count of dropped records. Updated by the producer.
+    std::atomic<uint64_t> dropped{0};
+    char padding[64 - 2 * sizeof(std::atomic<uint64_t>)];
+    /// Count of consumed records. Updated by the consumer.
+    std::atomic<uint64_t> tail{0};
+    /// Count of dropped records already reported by the consumer.
+    uint64_t reportedDropped = 0;
+    uint16_t thread = 0;
+    http::log_record records[CAPACITY];
+};
+
+/// Rings of all threads which have ever logged. Rings are never freed,
+/// so a thread may log at any moment of its life.
+std::mutex ringsMutex;
+std::vector<std::unique_ptr<log_ring>> rings;
+thread_local log_ring* localRing = nullptr;
+
+constexpr auto IDLE_DELAY = std::chrono::milliseconds(10);
+
+const char* const LEVEL_NAMES[] = {"debug", "info", "warning", "error"
+                                 , "none"};
+
+log_ring& getLocalRing() {
+    if (!localRing) {
+        std::unique_ptr<log_ring> ring(new log_ring());
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        ring->thread = static_cast<uint16_t>(rings.size());
+        localRing = ring.get();
+        rings.push_back(std::move(ring));
+    }
+    return *localRing;
+}
+
+/**
+ * @brief Get a free record of the thread ring.
+ *
+ * @return nullptr if the ring is full.
+ */
+http::log_record* reserve(http::log_level level, http::log_record::kind type) {
+    auto& ring = getLocalRing();
+    const auto head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= log_ring::CAPACITY) {
+        ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1
+                         , std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    auto& record = ring.records[head % log_ring::CAPACITY];
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    record.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            now).count();
+    record.thread = ring.thread;
+    record.level = level;
+    record.type = type;
+    return &record;
+}
+
+void commit() {
+    auto& ring = *localRing;
+    ring.head.store(ring.head.load(std::memory_order_relaxed) + 1
+                  , std::memory_order_release);
+}
+
+void appendRecord(const http::log_record& record, bool binary
+                , std::string& out) {
+    if (binary)
+        out.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    else
+        http::formatLogRecord(record, out);
+}
+
+bool writeAll(int file, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        const auto bytesWritten = write(file, data.data() + done
+                                      , data.size() - done);
+        if (bytesWritten < 0 && errno == EINTR)
+            continue;
+        if (bytesWritten < 0)
+            return false;
+        done += bytesWritten;
+    }
+    return true;
+}
+}
+
+namespace http {
+constexpr size_t log_record::SIZE;
+constexpr size_t log_record::TEXT_SIZE;
+constexpr char log_file_header::MAGIC[8];
+std::atomic<log_level> logger::threshold{log_level::none};
+
+logger::logger(const logger_options& options)
+    : m_file(STDOUT_FILENO)
+    , m_ownsFile(!options.path.empty())
+    , m_binary(options.binary)
+{
+    if (m_ownsFile) {
+        m_file = open(options.path.c_str()
+                    , O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (m_file < 0) {
+            perror("");
+            throw std::runtime_error("Can't open log file");
+        }
+    }
+
+    if (m_binary) {
+        log_file_header header;
+        std::copy(log_file_header::MAGIC, log_file_header::MAGIC + 8
+                , header.magic);
+        header.version = log_file_header::VERSION;
+        header.recordSize = sizeof(log_record);
+        writeAll(m_file, std::string(reinterpret_cast<const char*>(&header)
+                                   , sizeof(header)));
+    }
+
+    m_writer = std::thread(&logger::run, this);
+    threshold.store(options.level, std::memory_order_relaxed);
+}
+
+logger::~logger() {
+    threshold.store(log_level::none, std::memory_order_relaxed);
+    m_stopping.store(true, std::memory_order_release);
+    m_writer.join();
+    if (m_ownsFile)
+        close(m_file);
+}
+
+void logger::access(uint32_t peer, const char* request, size_t size
+                  , int status, uint64_t bytes, uint64_t duration) noexcept {
+    if (!enabled(log_level::info))
+        return;
+    const auto record = reserve(log_level::info, log_record::kind::access);
+    if (!record)
+        return;
+    record->peer = peer;
+    record->status = static_cast<uint16_t>(status);
+    record->bytes = bytes;
+    record->duration = static_cast<uint32_t>(
+            std::min<uint64_t>(duration, UINT32_MAX));
+    record->length = static_cast<uint8_t>(
+            std::min(size, log_record::TEXT_SIZE));
+    std::memcpy(record->text, request, record->length);
+    commit();
+}
+
+void logger::message(log_level level, const char* format, ...) noexcept {
+    if (!enabled(level))
+        return;
+    const auto record = reserve(level, log_record::kind::message);
+    if (!record)
+        return;
+    va_list args;
+    va_start(args, format);
+    const auto length = vsnprintf(record->text, log_record::TEXT_SIZE
+                                , format, args);
+    va_end(args);
+    record->length = static_cast<uint8_t>(
+            std::min<size_t>(std::max(length, 0), log_record::TEXT_SIZE - 1));
+    record->peer = 0;
+    record->status = 0;
+    record->bytes = 0;
+    record->duration = 0;
+    commit();
+}
+
+void logger::run() {
+    std::vector<log_ring*> snapshot;
+    std::string batch;
+    while (true) {
+        // Check the flag before draining, so records logged before
+        // the destructor was called are written.
+        const auto stopping = m_stopping.load(std::memory_order_acquire);
+        {
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            snapshot.clear();
+            for (const auto& ring: rings)
+                snapshot.push_back(ring.get());
+        }
+
+        batch.clear();
+        for (const auto ring: snapshot) {
+            const auto tail = ring->tail.load(std::memory_order_relaxed);
+            const auto head = ring->head.load(std::memory_order_acquire);
+            for (auto i = tail; i != head; ++i)
+                appendRecord(ring->records[i % log_ring::CAPACITY], m_binary
+                           , batch);
+            ring->tail.store(head, std::memory_order_release);
+
+            const auto dropped = ring->dropped.load(std::memory_order_relaxed);
+            if (dropped != ring->reportedDropped) {
+                log_record record{};
+                record.time = std::chrono::duration_cast<
+                    std::chrono::nanoseconds>(std::chrono::system_clock::now()
+                                              .time_since_epoch()).count();
+                record.thread = ring->thread;
+                record.level = log_level::warning;
+                record.type = log_record::kind::message;
+                record.length = snprintf(record.text, log_record::TEXT_SIZE
+                                       , "%llu log records were dropped"
+                                       , static_cast<unsigned long long>(
+                                           dropped - ring->reportedDropped));
+                ring->reportedDropped = dropped;
+                appendRecord(record, m_binary, batch);
+            }
+        }
+
+        if (!batch.empty() && !writeAll(m_file, batch))
+            perror("");
+        if (stopping)
+            break;
+        if (batch.empty())
+            std::this_thread::sleep_for(IDLE_DELAY);
+    }
+}
+
+bool parseLogLevel(const std::string& name, log_level& level) {
+    for (size_t i = 0; i <= static_cast<size_t>(log_level::none); ++i) {
+        if (name == LEVEL_NAMES[i]) {
+            level = static_cast<log_level>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void formatLogRecord(const log_record& record, std::string& out) {
+    const time_t seconds = record.time / 1000000000;
+    const auto micros = static_cast<unsigned>(record.time / 1000 % 1000000);
+    tm time;
+    gmtime_r(&seconds, &time);
+    const auto level = static_cast<size_t>(record.level)
+                     < sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0])
+                     ? LEVEL_NAMES[static_cast<size_t>(record.level)]
+                     : "?";
+    char prefix[96];
+    snprintf(prefix, sizeof(prefix)
+           , "%04d-%02d-%02dT%02d:%02d:%02d.%06uZ %s [%u] "
+           , time.tm_year + 1900, time.tm_mon + 1, time.tm_mday
+           , time.tm_hour, time.tm_min, time.tm_sec, micros, level
+           , static_cast<unsigned>(record.thread));
+    out += prefix;
+
+    const auto length = std::min<size_t>(record.length, log_record::TEXT_SIZE);
+    if (record.type == log_record::kind::access) {
+        char address[INET_ADDRSTRLEN] = "-";
+        if (record.peer != 0) {
+            in_addr peer;
+            peer.s_addr = record.peer;
+            inet_ntop(AF_INET, &peer, address, sizeof(address));
+        }
+        char suffix[64];
+        snprintf(suffix, sizeof(suffix), "\" %u %llu %uus\n"
+               , static_cast<unsigned>(record.status)
+               , static_cast<unsigned long long>(record.bytes)
+               , static_cast<unsigned>(record.duration / 1000));
+        out += address;
+        out += " \"";
+        out.append(record.text, length);
+        out += suffix;
+    } else {
+        out.append(record.text, length);
+        out += '\n';
+    }
+}
+} // namespace http
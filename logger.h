@@ -0,0 +1,162 @@
+/*
+ * logger.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace http {
+enum class log_level : uint8_t {
+    debug,
+    info,
+    warning,
+    error,
+    /// Nothing is logged.
+    none
+};
+
+/**
+ * @brief Fixed-size log record.
+ * Binary log is a log_file_header followed by records as they are in memory.
+ */
+struct log_record {
+    static constexpr size_t SIZE = 128;
+    static constexpr size_t TEXT_SIZE = SIZE - 31;
+
+    enum class kind : uint8_t {
+        message,
+        access
+    };
+
+    /// Wall clock time in nanoseconds since the epoch.
+    uint64_t time;
+    /// Access: reply size in bytes.
+    uint64_t bytes;
+    /// Access: time spent preparing the reply in nanoseconds.
+    uint32_t duration;
+    /// Access: client IPv4 address in network byte order, zero if unknown.
+    uint32_t peer;
+    /// Access: reply status code.
+    uint16_t status;
+    /// Number of the thread which wrote the record.
+    uint16_t thread;
+    log_level level;
+    kind type;
+    /// Length of text.
+    uint8_t length;
+    /// Access: method and URI. Message: message text. Truncated to fit.
+    char text[TEXT_SIZE];
+};
+
+static_assert(sizeof(log_record) == log_record::SIZE
+            , "Binary log format depends on the record size");
+
+/**
+ * @brief Header of a binary log file.
+ */
+struct log_file_header {
+    static constexpr char MAGIC[8] = {'H', 'T', 'T', 'P', 'L', 'O', 'G', '\0'};
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+};
+
+/**
+ * @brief Logger parameters.
+ */
+struct logger_options {
+    /// Log file path. Empty string means the standard output.
+    std::string path;
+    /// Records below the level are not logged.
+    log_level level = log_level::info;
+    /// Write raw records instead of text lines.
+    bool binary = false;
+};
+
+/**
+ * @brief Asynchronous logger.
+ * Every thread writes fixed-size records into its own lock-free ring,
+ * a background thread drains all rings and writes records to a file
+ * in batches. Logging never blocks: when a ring is full the record is
+ * dropped and counted. Only one logger may exist at a time, nothing is
+ * logged while there is no logger.
+ */
+class logger {
+    public:
+        /**
+         * @brief Open the log file and start the writer thread.
+         *
+         * @param options - Logger parameters.
+         */
+        explicit logger(const logger_options& options) noexcept(false);
+
+        /**
+         * @brief Write everything logged so far and stop the writer thread.
+         */
+        ~logger();
+
+        logger(const logger&) = delete;
+        logger& operator=(const logger&) = delete;
+
+        static bool enabled(log_level level) noexcept {
+            return level >= threshold.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Log a served request.
+         *
+         * @param peer - Client IPv4 address in network byte order.
+         * @param request - Method and URI.
+         * @param size - Size of request.
+         * @param status - Reply status code.
+         * @param bytes - Reply size.
+         * @param duration - Time spent preparing the reply in nanoseconds.
+         */
+        static void access(uint32_t peer, const char* request, size_t size
+                         , int status, uint64_t bytes
+                         , uint64_t duration) noexcept;
+
+        /**
+         * @brief Log a printf-style formatted message.
+         */
+        static void message(log_level level, const char* format, ...) noexcept
+            __attribute__((format(printf, 2, 3)));
+
+    private:
+        void run();
+
+    private:
+        static std::atomic<log_level> threshold;
+
+        int m_file;
+        bool m_ownsFile;
+        bool m_binary;
+        std::atomic<bool> m_stopping{false};
+        std::thread m_writer;
+};
+
+/**
+ * @brief Parse a level name: debug, info, warning, error or none.
+ *
+ * @return false if the name is unknown.
+ */
+bool parseLogLevel(const std::string& name, log_level& level);
+
+/**
+ * @brief Append a record as a text line.
+ */
+void formatLogRecord(const log_record& record, std::string& out);
+} // namespace http
+
+#endif /* !LOGGER_H */
@@ -10,15 +10,19 @@
 #include <vector>
 
 #include "common.h"
+#include "handover.h"
+#include "logger.h"
 #include "server.h"
 
 int main(int argc, char **argv) {
-    static const std::string optstring("h:p:d:");
+    static const std::string optstring("h:p:d:w:ac:f:nW:t:s:k:e:l:L:bB:Pm:r:q:i:R:K:D:");
 
     int c{0};
     std::string address;
     std::string port;
     std::string rootDirectory;
+    http::server_options options;
+    http::logger_options logOptions;
     while ( (c = getopt(argc, argv, optstring.c_str())) != -1) {
         switch (c) {
             case 'h':
@@ -30,6 +34,80 @@ int main(int argc, char **argv) {
             case 'd':
                 rootDirectory = optarg;
                 break;
+            case 'w':
+                options.workers = getFromStr<unsigned>(optarg);
+                break;
+            case 'a':
+                options.pinWorkers = true;
+                break;
+            case 'c':
+                options.cacheSize = getFromStr<size_t>(optarg);
+                break;
+            case 'f':
+                options.fdCacheSize = getFromStr<size_t>(optarg);
+                break;
+            case 'n':
+                options.watchRoot = false;
+                break;
+            case 'W':
+                options.warmupSize = getFromStr<size_t>(optarg);
+                break;
+            case 't':
+                options.headerTimeout = getFromStr<unsigned>(optarg) * 1000;
+                break;
+            case 's':
+                options.sendTimeout = getFromStr<unsigned>(optarg) * 1000;
+                break;
+            case 'k':
+                options.idleTimeout = getFromStr<unsigned>(optarg) * 1000;
+                break;
+            case 'e':
+                if (!http::parseEngine(optarg, options.engine)) {
+                    std::cerr << "Unknown I/O engine \"" << optarg << '\"'
+                              << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'l':
+                logOptions.path = optarg;
+                break;
+            case 'L':
+                if (!http::parseLogLevel(optarg, logOptions.level)) {
+                    std::cerr << "Unknown log level \"" << optarg << '\"'
+                              << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'b':
+                logOptions.binary = true;
+                break;
+            case 'B':
+                options.bundlePath = optarg;
+                break;
+            case 'P':
+                options.bundlePopulate = true;
+                break;
+            case 'm':
+                options.maxConnections = getFromStr<size_t>(optarg);
+                break;
+            case 'r':
+                options.maxRequests = getFromStr<size_t>(optarg);
+                break;
+            case 'q':
+                options.queueTarget = getFromStr<unsigned>(optarg);
+                break;
+            case 'i':
+                options.queueInterval = getFromStr<unsigned>(optarg);
+                break;
+            case 'R':
+                options.retryAfter = getFromStr<unsigned>(optarg);
+                break;
+            case 'K':
+                options.listenBacklog = getFromStr<int>(optarg);
+                break;
+            case 'D':
+                options.drainTimeout = getFromStr<unsigned>(optarg) * 1000;
+                break;
             case '?':
             {
                 const auto it = optstring.find(optopt);
@@ -49,20 +127,47 @@ int main(int argc, char **argv) {
 
     if (port.empty() || address.empty()) {
         std::cerr << "Usage: " << argv[0]
-                  << " -h <IP> -p <port> -d <directory>" << std::endl;
+                  << " -h <IP> -p <port> -d <directory>"
+                  << " [-w <workers>] [-a] [-c <cache bytes>]"
+                  << " [-f <cached descriptors>] [-n] [-W <warm-up bytes>]"
+                  << " [-t <header seconds>] [-s <send seconds>]"
+                  << " [-k <keep-alive seconds>]"
+                  << " [-e epoll|uring] [-B <bundle>] [-P]"
+                  << " [-m <connections>] [-r <requests in flight>]"
+                  << " [-q <queue target ms>] [-i <queue interval ms>]"
+                  << " [-R <retry-after seconds>] [-K <listen backlog>]"
+                  << " [-D <drain seconds>]"
+                  << " [-l <log file>] [-L <log level>] [-b]" << std::endl;
         exit(EXIT_FAILURE);
     }
 
+    // SIGUSR2 starts the same command, so a replaced binary takes over.
+    options.restartCommand.assign(argv, argv + argc);
+    const auto handoverChannel = http::takeHandoverChannel();
+
     callStdlibFunc(abort, daemon, 1, 1);
 
     std::cout << "[" << getpid() << "]"           << std::endl
         << "address = "          << address       << std::endl
         << "port = "             << port          << std::endl
-        << "root directory = "   << rootDirectory << std::endl;
+        << "root directory = "   << rootDirectory << std::endl
+        << "workers = "          << options.workers << std::endl
+        << "engine = "           << http::engineName(options.engine)
+                                 << std::endl
+        << "cache size = "       << options.cacheSize << std::endl
+        << "fd cache size = "    << options.fdCacheSize << std::endl;
 
     try {
-        http::server server(address, getFromStr<short>(port), rootDirectory);
-        server.joinToAcceptorThread();
+        // Logger thread is started after daemon(), threads do not survive
+        // fork().
+        http::logger logger(logOptions);
+        if (handoverChannel >= 0)
+            options.listenSockets = http::receiveSockets(handoverChannel);
+        http::server server(address, getFromStr<short>(port), rootDirectory
+                          , options);
+        if (handoverChannel >= 0)
+            http::notifyReady(handoverChannel);
+        server.joinWorkers();
     } catch (std::exception& ex) {
         std::cerr << "Exception: " << ex.what() << std::endl;
         exit(EXIT_FAILURE);
@@ -0,0 +1,179 @@
+/*
+ * metrics.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "metrics.h"
+
+#include <sstream>
+
+namespace {
+thread_local http::metrics_shard* localShard = nullptr;
+
+/// Bucket bounds of exported histograms in nanoseconds.
+const uint64_t EXPORTED_BOUNDS[] = {
+    1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000
+  , 10000000, 50000000, 100000000, 500000000, 1000000000, 5000000000
+};
+
+void writeCounter(std::ostream& out, const char* name, const char* help
+                , uint64_t value) {
+    out << "# HELP " << name << ' ' << help << '\n'
+        << "# TYPE " << name << " counter\n"
+        << name << ' ' << value << '\n';
+}
+
+/**
+ * @brief Write a histogram with coarse buckets of Prometheus convention.
+ * Fine bucket is counted in the first exported bucket which bound is not
+ * below the fine bucket upper bound.
+ */
+void writeHistogram(std::ostream& out, const char* name, const char* help
+                  , const std::vector<uint64_t>& buckets, uint64_t sum) {
+    out << "# HELP " << name << ' ' << help << '\n'
+        << "# TYPE " << name << " histogram\n";
+    uint64_t count = 0;
+    size_t bucket = 0;
+    for (const auto bound: EXPORTED_BOUNDS) {
+        for (; bucket < buckets.size()
+                && http::histogram::upperBound(bucket) <= bound; ++bucket)
+            count += buckets[bucket];
+        out << name << "_bucket{le=\"" << bound / 1e9 << "\"} "
+            << count << '\n';
+    }
+    for (; bucket < buckets.size(); ++bucket)
+        count += buckets[bucket];
+    out << name << "_bucket{le=\"+Inf\"} " << count << '\n'
+        << name << "_sum " << sum / 1e9 << '\n'
+        << name << "_count " << count << '\n';
+}
+}
+
+namespace http {
+constexpr size_t histogram::BUCKETS;
+
+void histogram::addTo(std::vector<uint64_t>& buckets, uint64_t& sum) const {
+    buckets.resize(BUCKETS);
+    for (size_t i = 0; i < BUCKETS; ++i)
+        buckets[i] += m_buckets[i].get();
+    sum += m_sum.get();
+}
+
+size_t histogram::bucketOf(uint64_t value) noexcept {
+    if (value < SUB_BUCKETS)
+        return value;
+    const unsigned exponent = 63 - __builtin_clzll(value);
+    const auto shift = exponent - SUB_BUCKET_BITS;
+    const auto sub = (value >> shift) & (SUB_BUCKETS - 1);
+    return (shift + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t histogram::upperBound(size_t bucket) noexcept {
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+    const auto shift = bucket / SUB_BUCKETS - 1;
+    const uint64_t sub = bucket % SUB_BUCKETS;
+    // Computed as lower bound plus width minus one to avoid an overflow.
+    return ((SUB_BUCKETS + sub) << shift) + ((uint64_t(1) << shift) - 1);
+}
+
+metrics::metrics(size_t shards) {
+    m_shards.reserve(shards);
+    for (size_t i = 0; i < shards; ++i)
+        m_shards.emplace_back(new metrics_shard());
+}
+
+void metrics::attach(metrics_shard* shard) noexcept {
+    localShard = shard;
+}
+
+metrics_shard& metrics::local() noexcept {
+    static metrics_shard detached;
+    return localShard ? *localShard : detached;
+}
+
+std::string metrics::prometheus() const {
+    constexpr int STATUSES = metrics_shard::MAX_STATUS
+                           - metrics_shard::MIN_STATUS + 1;
+    uint64_t requests[STATUSES] = {};
+    std::vector<uint64_t> parseBuckets, lookupBuckets, sendBuckets;
+    std::vector<uint64_t> queueBuckets;
+    uint64_t accepts = 0, timeouts = 0, bytesSent = 0, parseErrors = 0;
+    uint64_t cacheHits = 0, cacheMisses = 0;
+    uint64_t fdCacheHits = 0, fdCacheMisses = 0;
+    uint64_t bundleHits = 0, bundleMisses = 0;
+    uint64_t shedRequests = 0, shedDelay = 0, acceptPauses = 0;
+    uint64_t parseSum = 0, lookupSum = 0, sendSum = 0, queueSum = 0;
+    for (const auto& shard: m_shards) {
+        accepts += shard->accepts.get();
+        timeouts += shard->timeouts.get();
+        for (int i = 0; i < STATUSES; ++i)
+            requests[i] += shard->requests[i].get();
+        bytesSent += shard->bytesSent.get();
+        parseErrors += shard->parseErrors.get();
+        cacheHits += shard->cacheHits.get();
+        cacheMisses += shard->cacheMisses.get();
+        fdCacheHits += shard->fdCacheHits.get();
+        fdCacheMisses += shard->fdCacheMisses.get();
+        bundleHits += shard->bundleHits.get();
+        bundleMisses += shard->bundleMisses.get();
+        shedRequests += shard->shedRequests.get();
+        shedDelay += shard->shedDelay.get();
+        acceptPauses += shard->acceptPauses.get();
+        shard->parseTime.addTo(parseBuckets, parseSum);
+        shard->lookupTime.addTo(lookupBuckets, lookupSum);
+        shard->sendTime.addTo(sendBuckets, sendSum);
+        shard->queueDelay.addTo(queueBuckets, queueSum);
+    }
+
+    std::ostringstream out;
+    writeCounter(out, "http_accepts_total", "Accepted connections."
+               , accepts);
+    writeCounter(out, "http_timeouts_total"
+               , "Connections closed because a deadline passed.", timeouts);
+    out << "# HELP http_requests_total Replies by status code.\n"
+        << "# TYPE http_requests_total counter\n";
+    for (int i = 0; i < STATUSES; ++i) {
+        if (requests[i] == 0)
+            continue;
+        out << "http_requests_total{status=\""
+            << i + metrics_shard::MIN_STATUS << "\"} " << requests[i] << '\n';
+    }
+    writeCounter(out, "http_sent_bytes_total", "Bytes sent to clients."
+               , bytesSent);
+    writeCounter(out, "http_parse_errors_total", "Malformed requests."
+               , parseErrors);
+    writeCounter(out, "http_cache_hits_total", "File cache hits."
+               , cacheHits);
+    writeCounter(out, "http_cache_misses_total", "File cache misses."
+               , cacheMisses);
+    writeCounter(out, "http_fd_cache_hits_total"
+               , "Open file descriptor cache hits.", fdCacheHits);
+    writeCounter(out, "http_fd_cache_misses_total"
+               , "Open file descriptor cache misses.", fdCacheMisses);
+    writeCounter(out, "http_bundle_hits_total"
+               , "Files served from the bundle.", bundleHits);
+    writeCounter(out, "http_bundle_misses_total"
+               , "Files looked up in the file system after the bundle."
+               , bundleMisses);
+    out << "# HELP http_shed_total Requests answered with 503 by reason.\n"
+        << "# TYPE http_shed_total counter\n"
+        << "http_shed_total{reason=\"requests\"} " << shedRequests << '\n'
+        << "http_shed_total{reason=\"delay\"} " << shedDelay << '\n';
+    writeCounter(out, "http_accept_pauses_total"
+               , "Times accepting paused at a limit.", acceptPauses);
+    writeHistogram(out, "http_parse_duration_seconds"
+                 , "Time spent parsing a request.", parseBuckets, parseSum);
+    writeHistogram(out, "http_lookup_duration_seconds"
+                 , "Time spent preparing a reply.", lookupBuckets, lookupSum);
+    writeHistogram(out, "http_send_duration_seconds"
+                 , "Time from a ready reply until it is sent."
+                 , sendBuckets, sendSum);
+    writeHistogram(out, "http_queue_delay_seconds"
+                 , "Time a parsed request waited for its worker."
+                 , queueBuckets, queueSum);
+    return out.str();
+}
+} // namespace http
@@ -0,0 +1,172 @@
+/*
+ * metrics.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace http {
+/**
+ * @brief Counter written by one thread and read by any thread.
+ * The owner updates it with a plain load and store, so there is no locked
+ * instruction on the hot path, readers see a slightly stale value.
+ */
+class counter {
+    public:
+        void add(uint64_t value = 1) noexcept {
+            m_value.store(m_value.load(std::memory_order_relaxed) + value
+                        , std::memory_order_relaxed);
+        }
+
+        uint64_t get() const noexcept {
+            return m_value.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<uint64_t> m_value{0};
+};
+
+/**
+ * @brief Log-linear histogram of durations in nanoseconds.
+ * Every power of two range is split into SUB_BUCKETS equal buckets, like in
+ * HdrHistogram, so relative error of a recorded value is below 1/SUB_BUCKETS
+ * for the whole 64-bit range. It has the same threading rules as counter.
+ */
+class histogram {
+    public:
+        static constexpr unsigned SUB_BUCKET_BITS = 4;
+        static constexpr unsigned SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+        static constexpr size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1)
+                                        * SUB_BUCKETS;
+
+        void record(uint64_t value) noexcept {
+            m_buckets[bucketOf(value)].add();
+            m_sum.add(value);
+        }
+
+        /**
+         * @brief Add bucket counts to a snapshot.
+         *
+         * @param buckets - Counts of BUCKETS buckets.
+         * @param sum - Sum of recorded values.
+         */
+        void addTo(std::vector<uint64_t>& buckets, uint64_t& sum) const;
+
+        static size_t bucketOf(uint64_t value) noexcept;
+
+        /**
+         * @brief Largest value which falls into a bucket.
+         */
+        static uint64_t upperBound(size_t bucket) noexcept;
+
+    private:
+        counter m_buckets[BUCKETS];
+        counter m_sum;
+};
+
+/**
+ * @brief Metrics of one worker thread.
+ * Only the owner thread updates a shard, so no locks are taken on the
+ * hot path. Shards are allocated separately and span many cache lines,
+ * so threads practically never write to a shared line.
+ */
+struct metrics_shard {
+    static constexpr int MIN_STATUS = 100;
+    static constexpr int MAX_STATUS = 599;
+
+    counter accepts;
+    /// Connections closed because a deadline passed.
+    counter timeouts;
+    /// Replies by status code starting from MIN_STATUS.
+    counter requests[MAX_STATUS - MIN_STATUS + 1];
+    counter bytesSent;
+    counter parseErrors;
+    counter cacheHits;
+    counter cacheMisses;
+    counter fdCacheHits;
+    counter fdCacheMisses;
+    counter bundleHits;
+    counter bundleMisses;
+    /// Requests answered with 503 because too many were in flight.
+    counter shedRequests;
+    /// Requests answered with 503 because they waited too long.
+    counter shedDelay;
+    /// Times accepting paused at a connection or request limit.
+    counter acceptPauses;
+    /// Time spent by the parser on one request.
+    histogram parseTime;
+    /// Time from a parsed request to a ready reply.
+    histogram lookupTime;
+    /// Time from a ready reply to the moment it is completely sent.
+    histogram sendTime;
+    /// Time a parsed request waited for the loop, see admission.
+    histogram queueDelay;
+
+    void countReply(int status) noexcept {
+        if (status >= MIN_STATUS && status <= MAX_STATUS)
+            requests[status - MIN_STATUS].add();
+    }
+};
+
+/**
+ * @brief Metrics of all worker threads.
+ * Each worker attaches its shard to its thread, the shards are summed up
+ * only when metrics are read.
+ */
+class metrics {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        /**
+         * @brief Construct metrics.
+         *
+         * @param shards - Count of shards, one for every worker.
+         */
+        explicit metrics(size_t shards);
+
+        metrics(const metrics&) = delete;
+        metrics& operator=(const metrics&) = delete;
+
+        metrics_shard& shard(size_t index) noexcept {
+            return *m_shards[index];
+        }
+
+        /**
+         * @brief Render metrics in Prometheus text exposition format.
+         */
+        std::string prometheus() const;
+
+        /**
+         * @brief Make a shard the one returned by local() for this thread.
+         */
+        static void attach(metrics_shard* shard) noexcept;
+
+        /**
+         * @brief Shard of the calling thread.
+         * Threads without an attached shard share a detached one which is
+         * not reported.
+         */
+        static metrics_shard& local() noexcept;
+
+        static uint64_t now() noexcept {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    clock::now().time_since_epoch()).count();
+        }
+
+    private:
+        std::vector<std::unique_ptr<metrics_shard>> m_shards;
+};
+} // namespace http
+
+#endif /* !METRICS_H */
@@ -22,7 +22,7 @@ class optional
         explicit optional(T&& val) noexcept
             : initialized(true)
         {
-            new (&value) T(std::move<T>(val));
+            new (&value) T(std::move(val));
         }
         explicit optional(const T& val) noexcept
             : initialized(true)
@@ -56,7 +56,7 @@ class optional
 
     private:
         bool initialized;
-        std::aligned_storage<sizeof(T), alignof(T)> value;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type value;
 };
 
 template <typename T>
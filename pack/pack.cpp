@@ -0,0 +1,40 @@
+/*
+ * pack.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+/*
+ * Bundle compiler. It packs a directory into one file which the server
+ * maps with "final -B <bundle>" and serves without file system lookups.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "bundle.h"
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <directory> <bundle file>"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::string rootDir = argv[1];
+    if (rootDir.empty() || rootDir.back() != '/')
+        rootDir += '/';
+    try {
+        const auto count = http::packBundle(rootDir, argv[2]);
+        std::cout << "Packed " << count << " files into " << argv[2]
+                  << std::endl;
+    } catch (std::exception& ex) {
+        fprintf(stderr, "Exception: %s\n", ex.what());
+        exit(EXIT_FAILURE);
+    }
+    return 0;
+}
@@ -0,0 +1,686 @@
+/*
+ * request_handler.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "request_handler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <memory>
+#include <random>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "logger.h"
+
+namespace {
+using sized_path = std::pair<off_t, std::string>;
+
+/**
+ * @brief Append regular files of a directory tree with their sizes.
+ * Symbolic links are skipped, so there are no cycles.
+ *
+ * @param dir - Directory path ending with '/'.
+ * @param files - Output list.
+ */
+void listFiles(const std::string& dir, std::vector<sized_path>& files) {
+    const auto d = opendir(dir.c_str());
+    if (!d)
+        return;
+    while (const auto entry = readdir(d)) {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+        const auto path = dir + name;
+        struct stat fileStat;
+        if (lstat(path.c_str(), &fileStat) < 0)
+            continue;
+        if (S_ISDIR(fileStat.st_mode))
+            listFiles(path + '/', files);
+        else if (S_ISREG(fileStat.st_mode))
+            files.emplace_back(fileStat.st_size, path);
+    }
+    closedir(d);
+}
+
+bool readAll(int file, size_t size, std::string& result) {
+    result.resize(size);
+    size_t done = 0;
+    while (done < size) {
+        const auto bytesRead = pread(file, &result[done], size - done, done);
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead <= 0)
+            return false;
+        done += bytesRead;
+    }
+    return true;
+}
+
+/**
+ * @brief Add headers common for all replies with a file.
+ * Replies which could be compressed vary by Accept-Encoding.
+ */
+void addFileHeaders(http::head_builder& head, const char* type
+                  , const std::string& validators) {
+    head.text(validators).text("Accept-Ranges: bytes\r\n");
+    if (http::isCompressible(type))
+        head.text("Vary: Accept-Encoding\r\n");
+}
+
+/**
+ * @brief Serialize head of a reply with a whole file body.
+ */
+http::const_buffer makeFileHead(http::arena& memory, size_t size
+                              , const char* type
+                              , http::content_encoding encoding
+                              , const std::string& validators) {
+    http::head_builder head(200);
+    head.add("Content-Length", size).add("Content-Type", type);
+    if (encoding != http::content_encoding::identity)
+        head.add("Content-Encoding", http::encodingName(encoding));
+    addFileHeaders(head, type, validators);
+    return head.finish(memory);
+}
+
+/**
+ * @brief Check if If-None-Match list has an entity tag.
+ * Tags are compared weakly, W/ prefixes are ignored.
+ */
+bool hasEntityTag(const char* it, const char* end
+                , const http::const_buffer& etag) {
+    while (it < end) {
+        if (*it == ' ' || *it == '\t' || *it == ',') {
+            ++it;
+            continue;
+        }
+        if (*it == '*')
+            return true;
+        if (end - it > 2 && it[0] == 'W' && it[1] == '/')
+            it += 2;
+        if (*it != '"')
+            return false;
+        const auto tagEnd = std::find(it + 1, end, '"');
+        if (tagEnd == end)
+            return false;
+        if (static_cast<size_t>(tagEnd + 1 - it) == etag.size
+                && std::equal(it, tagEnd + 1, etag.data))
+            return true;
+        it = tagEnd + 1;
+    }
+    return false;
+}
+
+/**
+ * @brief Check if a client has the current file, so 304 may be sent.
+ * If-Modified-Since is used only without If-None-Match.
+ */
+bool isNotModified(const http::request_view& request
+                 , const http::const_buffer& etag, time_t modified) {
+    const auto noneMatch = request.find_header("If-None-Match");
+    if (noneMatch) {
+        const auto value = request.data(noneMatch->value);
+        return hasEntityTag(value, value + noneMatch->value.length, etag);
+    }
+
+    const auto since = request.find_header("If-Modified-Since");
+    time_t date;
+    return since && http::parseHttpDate(request.data(since->value)
+                                      , since->value.length, date)
+        && modified <= date;
+}
+
+bool isNotModified(const http::request_view& request, const std::string& etag
+                 , time_t modified) {
+    return isNotModified(request, http::const_buffer{etag.data(), etag.size()}
+                       , modified);
+}
+
+http::response makeNotModified(http::arena& memory, const char* type
+                             , const std::string& validators) {
+    http::response result;
+    result.status = 304;
+    http::head_builder head(304);
+    head.text(validators);
+    if (http::isCompressible(type))
+        head.text("Vary: Accept-Encoding\r\n");
+    result.head = head.finish(memory);
+    return result;
+}
+
+/// Size of a Content-Range value buffer.
+constexpr size_t CONTENT_RANGE_SIZE = 80;
+
+/**
+ * @brief Format Content-Range value of a range.
+ *
+ * @param out - Output, at least CONTENT_RANGE_SIZE bytes.
+ *
+ * @return Pointer after the last written byte.
+ */
+char* formatContentRange(char* out, const http::byte_range& range
+                       , off_t fileSize) {
+    std::memcpy(out, "bytes ", 6);
+    out = http::formatNumber(out + 6, range.first);
+    *out++ = '-';
+    out = http::formatNumber(out, range.last);
+    *out++ = '/';
+    return http::formatNumber(out, fileSize);
+}
+
+http::response makeRangeNotSatisfiable(http::arena& memory, off_t fileSize) {
+    http::response result;
+    result.status = 416;
+    result.head = http::head_builder(416).add("Content-Length", "0")
+        .text("Content-Range: bytes */").number(fileSize).text("\r\n")
+        .finish(memory);
+    return result;
+}
+
+/**
+ * @brief Make a multipart boundary which is unlikely to occur in files.
+ */
+std::string makeBoundary() {
+    static thread_local std::mt19937_64 random(std::random_device{}());
+    char boundary[32];
+    snprintf(boundary, sizeof(boundary), "%016llx"
+           , static_cast<unsigned long long>(random()));
+    return boundary;
+}
+
+/**
+ * @brief Check if ranges may be sent for If-Range of a request.
+ * Entity tags are compared strongly, so a weak tag never matches.
+ */
+bool ifRangeMatches(const http::request_view& request
+                  , const http::const_buffer& etag, time_t modified) {
+    const auto ifRange = request.find_header("If-Range");
+    if (!ifRange)
+        return true;
+    const auto value = request.data(ifRange->value);
+    const auto length = ifRange->value.length;
+    time_t date;
+    return length > 0 && value[0] == '"'
+         ? length == etag.size && std::equal(value, value + length, etag.data)
+         : http::parseHttpDate(value, length, date) && date == modified;
+}
+
+/**
+ * @brief Prepare 206 reply with satisfiable ranges of a file.
+ * The first range is left in fileOffset and fileEnd, a multipart reply
+ * continues with segments. The caller sets the source of the bytes.
+ */
+void makePartialContent(http::arena& memory, const char* type
+                      , const std::string& validators
+                      , const std::vector<http::byte_range>& ranges
+                      , off_t fileSize, http::response& result) {
+    http::head_builder head(206);
+    char rangeValue[CONTENT_RANGE_SIZE];
+    if (ranges.size() == 1) {
+        head.add("Content-Length", ranges[0].length()).add("Content-Type", type)
+            .text("Content-Range: ")
+            .text(rangeValue, formatContentRange(rangeValue, ranges[0]
+                                               , fileSize) - rangeValue)
+            .text("\r\n");
+    } else {
+        const auto boundary = makeBoundary();
+        size_t contentSize = 0;
+        for (const auto& r: ranges) {
+            http::response::segment s;
+            s.prefix = "\r\n--" + boundary + "\r\nContent-Type: " + type
+                     + "\r\nContent-Range: ";
+            s.prefix.append(rangeValue, formatContentRange(rangeValue, r
+                                                         , fileSize));
+            s.prefix += "\r\n\r\n";
+            s.fileOffset = r.first;
+            s.fileEnd = r.last + 1;
+            contentSize += s.prefix.size() + r.length();
+            result.segments.push_back(std::move(s));
+        }
+        result.segments.push_back({"\r\n--" + boundary + "--\r\n", 0, 0});
+        contentSize += result.segments.back().prefix.size();
+        head.add("Content-Length", contentSize)
+            .text("Content-Type: multipart/byteranges; boundary=")
+            .text(boundary).text("\r\n");
+    }
+    addFileHeaders(head, type, validators);
+
+    result.status = 206;
+    result.head = head.finish(memory);
+    if (ranges.size() == 1) {
+        result.fileOffset = ranges[0].first;
+        result.fileEnd = ranges[0].last + 1;
+    } else {
+        // The first part is sent with the head.
+        auto& first = result.segments.front();
+        result.body = std::move(first.prefix);
+        result.fileOffset = first.fileOffset;
+        result.fileEnd = first.fileEnd;
+        result.segments.erase(result.segments.begin());
+    }
+}
+}
+
+namespace http {
+bool parseUri(const char* uri, size_t size, std::string& result) {
+    static const char PARENT_DIR[] = "..";
+    const auto end = uri + size;
+    if (size == 0 || uri[0] != '/'
+            || std::search(uri, end, PARENT_DIR, PARENT_DIR + 2) != end) {
+        logger::message(log_level::debug, "Invalid URI \"%.*s\""
+                      , static_cast<int>(size), uri);
+        return false;
+    }
+
+    for (auto it = uri + 1; it != end; ++it) {
+        const auto ch = *it;
+        if (ch == '%') {
+            logger::message(log_level::debug
+                          , "Internationalized URI is not supported");
+            return false;
+        }
+
+        if (ch == '&' || ch == ';' || ch == '?') {
+            break;
+        }
+        // Empty and "." segments are dropped, so every file has one path
+        // and the caches can be invalidated by it.
+        if (ch == '/' && result.back() == '/')
+            continue;
+        if (ch == '.' && result.back() == '/'
+                && (it + 1 == end || it[1] == '/'))
+            continue;
+        result += ch;
+    }
+
+    if (result.empty() || result.back() == '/')
+        result += "index.html";
+    return true;
+}
+
+request_handler::request_handler(const std::string& rootDir, file_cache* cache
+                               , fd_cache* files, const metrics* stats
+                               , const std::string& statsUri
+                               , const bundle* pack)
+    : m_rootDir(rootDir)
+    , m_cache(cache)
+    , m_files(files)
+    , m_stats(stats)
+    , m_statsUri(statsUri)
+    , m_bundle(pack)
+{}
+
+response request_handler::handle(const request_view& request
+                                , arena& memory) const {
+    const auto headOnly = request.equals(request.method, "HEAD");
+    if (!headOnly && !request.equals(request.method, "GET")) {
+        logger::message(log_level::debug, "Method %.*s is not supported"
+                      , static_cast<int>(request.method.length)
+                      , request.data(request.method));
+        return makeNotFound();
+    }
+
+    auto result = serve(request, memory);
+    if (headOnly)
+        result.omitBody();
+    return result;
+}
+
+response request_handler::serve(const request_view& request
+                               , arena& memory) const {
+    if (m_stats && request.equals(request.uri, m_statsUri.c_str()))
+        return makeStats(memory);
+
+    // Path buffer is reused by the worker thread to avoid allocations.
+    static thread_local std::string requestFile;
+    requestFile = m_rootDir;
+    if (!parseUri(request.data(request.uri), request.uri.length
+                , requestFile)) {
+        return makeNotFound();
+    }
+
+    response result;
+    if (m_bundle && serveBundled(requestFile.data() + m_rootDir.size()
+                               , requestFile.size() - m_rootDir.size()
+                               , request, memory, result))
+        return result;
+
+    const auto type = mimeType(requestFile);
+    // Ranges refer to the file itself, so they are sent without encoding.
+    if (serveRanges(requestFile, type, request, memory, result))
+        return result;
+    if (isCompressible(type)) {
+        const auto accepted = acceptedEncodings(request);
+        if (accepted && serveEncoded(requestFile, type, accepted, request
+                                   , memory, result))
+            return result;
+    }
+
+    if (!serveFile(requestFile, type, content_encoding::identity, request
+                 , memory, result)) {
+        logger::message(log_level::debug, "Can't open file: %s"
+                      , requestFile.c_str());
+        return makeNotFound();
+    }
+    return result;
+}
+
+bool request_handler::serveBundled(const char* path, size_t size
+                                 , const request_view& request
+                                 , arena& memory, response& result) const {
+    const auto entry = m_bundle->find(path, size);
+    if (!entry) {
+        metrics::local().bundleMisses.add();
+        return false;
+    }
+    metrics::local().bundleHits.add();
+
+    const auto* variant = &entry->variants[0];
+    const auto accepted = acceptedEncodings(request);
+    for (const auto encoding: {content_encoding::br, content_encoding::gzip}) {
+        const auto& v = entry->variants[static_cast<size_t>(encoding)];
+        if ((accepted & encodingBit(encoding)) && v.head.size) {
+            variant = &v;
+            break;
+        }
+    }
+
+    if (isNotModified(request, m_bundle->blob(variant->etag), entry->modified)) {
+        result.status = 304;
+        result.head = m_bundle->blob(variant->notModifiedHead);
+        return true;
+    }
+    // Ranges refer to the file itself, so they are sent without encoding.
+    if (serveBundledRanges(*entry, path, size, request, memory, result))
+        return true;
+    result.head = m_bundle->blob(variant->head);
+    result.mappedBody = m_bundle->blob(variant->body);
+    return true;
+}
+
+bool request_handler::serveBundledRanges(const bundle_entry& entry
+                                       , const char* path, size_t size
+                                       , const request_view& request
+                                       , arena& memory
+                                       , response& result) const {
+    const auto range = request.find_header("Range");
+    const auto& identity = entry.variants[
+            static_cast<size_t>(content_encoding::identity)];
+    const auto etag = m_bundle->blob(identity.etag);
+    if (!range || !ifRangeMatches(request, etag, entry.modified))
+        return false;
+
+    const auto body = m_bundle->blob(identity.body);
+    const auto fileSize = static_cast<off_t>(body.size);
+    static thread_local std::vector<byte_range> ranges;
+    switch (parseRanges(request.data(range->value), range->value.length
+                      , fileSize, ranges)) {
+        case range_status::ignored:
+            return false;
+        case range_status::unsatisfiable:
+            result = makeRangeNotSatisfiable(memory, fileSize);
+            return true;
+        case range_status::satisfiable:
+            break;
+    }
+
+    const auto validators = validatorHeaders(std::string(etag.data, etag.size)
+                                           , httpDate(entry.modified));
+    makePartialContent(memory, mimeType(std::string(path, size)), validators
+                     , ranges, fileSize, result);
+    if (result.segments.empty()) {
+        result.mappedBody = {body.data + result.fileOffset
+                           , static_cast<size_t>(result.fileEnd
+                                                 - result.fileOffset)};
+    } else {
+        // Parts are not contiguous in the mapping, so they are copied.
+        result.body.append(body.data + result.fileOffset
+                         , body.data + result.fileEnd);
+        for (const auto& s: result.segments) {
+            result.body += s.prefix;
+            result.body.append(body.data + s.fileOffset
+                             , body.data + s.fileEnd);
+        }
+        result.segments.clear();
+    }
+    result.fileOffset = result.fileEnd = 0;
+    return true;
+}
+
+bool request_handler::serveFile(const std::string& path, const char* type
+                              , content_encoding encoding
+                              , const request_view& request
+                              , arena& memory, response& result) const {
+    // Heads of cached files differ by encoding, see encodedCacheKey().
+    const auto key = m_cache ? encodedCacheKey(path, encoding) : std::string();
+    if (m_cache) {
+        result.cached = m_cache->find(key);
+        if (result.cached) {
+            metrics::local().cacheHits.add();
+            replyCached(type, request, memory, result);
+            return true;
+        }
+        metrics::local().cacheMisses.add();
+    }
+
+    auto file = openFile(path);
+    if (!file->exists())
+        return false;
+    if (isNotModified(request, file->etag, file->stat.st_mtime)) {
+        result = makeNotModified(memory, type, file->validators);
+        return true;
+    }
+
+    const auto size = static_cast<size_t>(file->stat.st_size);
+    const auto head = makeFileHead(memory, size, type, encoding
+                                 , file->validators);
+    if (m_cache && readToCache(key, *file, head, result))
+        return true;
+
+    result.file = file->fd;
+    result.fileEnd = size;
+    result.head = head;
+    result.openFile = std::move(file);
+    return true;
+}
+
+bool request_handler::serveRanges(const std::string& path, const char* type
+                                , const request_view& request
+                                , arena& memory, response& result) const {
+    const auto range = request.find_header("Range");
+    if (!range)
+        return false;
+    auto file = openFile(path);
+    if (!file->exists())
+        return false;
+
+    if (isNotModified(request, file->etag, file->stat.st_mtime)) {
+        result = makeNotModified(memory, type, file->validators);
+        return true;
+    }
+
+    const auto fileSize = file->stat.st_size;
+    // Otherwise the file has changed and is sent whole.
+    if (!ifRangeMatches(request, {file->etag.data(), file->etag.size()}
+                      , file->stat.st_mtime))
+        return false;
+
+    static thread_local std::vector<byte_range> ranges;
+    switch (parseRanges(request.data(range->value), range->value.length
+                      , fileSize, ranges)) {
+        case range_status::ignored:
+            return false;
+        case range_status::unsatisfiable:
+            result = makeRangeNotSatisfiable(memory, fileSize);
+            return true;
+        case range_status::satisfiable:
+            break;
+    }
+
+    makePartialContent(memory, type, file->validators, ranges, fileSize
+                     , result);
+    result.file = file->fd;
+    result.openFile = std::move(file);
+    return true;
+}
+
+bool request_handler::serveEncoded(const std::string& path, const char* type
+                                 , unsigned accepted
+                                 , const request_view& request
+                                 , arena& memory, response& result) const {
+    static thread_local std::string encodedFile;
+    for (const auto encoding: {content_encoding::br, content_encoding::gzip}) {
+        if (!(accepted & encodingBit(encoding)))
+            continue;
+        encodedFile = path;
+        encodedFile += encodingSuffix(encoding);
+        if (serveFile(encodedFile, type, encoding, request, memory, result))
+            return true;
+    }
+
+    // Without a cache the file would be compressed for every request.
+    if (!m_cache || !(accepted & encodingBit(content_encoding::gzip)))
+        return false;
+
+    const auto key = encodedCacheKey(path, content_encoding::gzip);
+    result.cached = m_cache->find(key);
+    if (result.cached) {
+        metrics::local().cacheHits.add();
+        replyCached(type, request, memory, result);
+        return true;
+    }
+    metrics::local().cacheMisses.add();
+
+    const auto file = openFile(path);
+    if (!file->exists())
+        return false;
+    const auto size = static_cast<size_t>(file->stat.st_size);
+    if (size > m_cache->maxEntrySize())
+        return false;
+
+    std::shared_ptr<cached_file> entry(new cached_file());
+    entry->stat = file->stat;
+    entry->lastModified = file->lastModified;
+    if (!readAll(file->fd, size, entry->body))
+        return false;
+    std::string compressed;
+    const_buffer head;
+    if (gzipCompress(entry->body, compressed)) {
+        // Compressed contents is another representation with its own tag.
+        entry->etag = file->etag;
+        entry->etag.insert(entry->etag.size() - 1, "-gzip");
+        entry->body = std::move(compressed);
+        entry->validators = validatorHeaders(entry->etag
+                                           , entry->lastModified);
+        head = makeFileHead(memory, entry->body.size(), type
+                          , content_encoding::gzip, entry->validators);
+    } else {
+        // Incompressible file is cached as is, so it is not compressed again.
+        entry->etag = file->etag;
+        entry->validators = file->validators;
+        head = makeFileHead(memory, size, type, content_encoding::identity
+                          , entry->validators);
+    }
+    entry->head.assign(head.data, head.size);
+    m_cache->insert(key, entry);
+    result.cached = std::move(entry);
+    replyCached(type, request, memory, result);
+    return true;
+}
+
+void request_handler::replyCached(const char* type, const request_view& request
+                                , arena& memory, response& result) const {
+    const auto& entry = *result.cached;
+    if (isNotModified(request, entry.etag, entry.stat.st_mtime))
+        result = makeNotModified(memory, type, entry.validators);
+}
+
+fd_cache::entry_ptr request_handler::openFile(const std::string& path) const {
+    if (!m_files)
+        return std::make_shared<open_file>(path, 0);
+
+    const auto now = metrics::now();
+    auto file = m_files->find(path, now);
+    if (file) {
+        metrics::local().fdCacheHits.add();
+        return file;
+    }
+    metrics::local().fdCacheMisses.add();
+    file = std::make_shared<open_file>(path, now + m_files->validity());
+    m_files->insert(path, file);
+    return file;
+}
+
+void request_handler::warmUp(size_t limit) const {
+    std::vector<sized_path> files;
+    listFiles(m_rootDir, files);
+    std::sort(files.begin(), files.end());
+
+    buffer_pool buffers(1);
+    arena memory(buffers);
+    size_t loaded = 0;
+    size_t count = 0;
+    for (const auto& f: files) {
+        const auto size = static_cast<size_t>(f.first);
+        if (loaded + size > limit)
+            break;
+        const auto file = openFile(f.second);
+        if (!file->exists())
+            continue;
+        response unused;
+        memory.reset();
+        // Files which do not go to file_cache are read ahead into the page
+        // cache, so their first sendfile does not wait for the disk.
+        if (!m_cache || !readToCache(f.second, *file
+                                   , makeFileHead(memory, size
+                                                , mimeType(f.second)
+                                                , content_encoding::identity
+                                                , file->validators)
+                                   , unused))
+            posix_fadvise(file->fd, 0, 0, POSIX_FADV_WILLNEED);
+        loaded += size;
+        ++count;
+    }
+    logger::message(log_level::info, "Warmed up %zu of %zu files, %zu bytes"
+                  , count, files.size(), loaded);
+}
+
+response request_handler::makeStats(arena& memory) const {
+    response result;
+    result.body = m_stats->prometheus();
+    result.head = head_builder(200).add("Content-Length", result.body.size())
+        .add("Content-Type", "text/plain; version=0.0.4").finish(memory);
+    return result;
+}
+
+bool request_handler::readToCache(const std::string& key
+                                , const open_file& file
+                                , const const_buffer& head
+                                , response& result) const {
+    const auto fileSize = static_cast<size_t>(file.stat.st_size);
+    if (fileSize > m_cache->maxEntrySize())
+        return false;
+
+    std::shared_ptr<cached_file> entry(new cached_file());
+    entry->stat = file.stat;
+    entry->etag = file.etag;
+    entry->lastModified = file.lastModified;
+    entry->validators = file.validators;
+    if (!readAll(file.fd, fileSize, entry->body))
+        return false;
+
+    entry->head.assign(head.data, head.size);
+    m_cache->insert(key, entry);
+    result.cached = std::move(entry);
+    return true;
+}
+} // namespace http
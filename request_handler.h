@@ -0,0 +1,172 @@
+/*
+ * request_handler.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef REQUEST_HANDLER_H
+#define REQUEST_HANDLER_H
+
+#include <cstddef>
+#include <string>
+
+#include "arena.h"
+#include "boost_parser/request_view.hpp"
+#include "bundle.h"
+#include "byte_range.h"
+#include "compression.h"
+#include "fd_cache.h"
+#include "file_cache.h"
+#include "metrics.h"
+#include "response.h"
+
+namespace http {
+/**
+ * @brief Append path of a file requested by URI to a string.
+ * Path is normalized: empty and "." segments are removed.
+ *
+ * @param uri - URI.
+ * @param size - URI size.
+ * @param result - Output path. Its contents are kept and the path appended.
+ *
+ * @return false if URI is invalid or unsupported.
+ */
+bool parseUri(const char* uri, size_t size, std::string& result);
+
+/**
+ * @brief Maps requests to files of the root directory.
+ * Handler is shared by all workers, so it must be safe to call handle()
+ * concurrently.
+ */
+class request_handler {
+    public:
+        /**
+         * @brief Construct a handler.
+         *
+         * @param rootDir - Root directory. Server will send requested files from it.
+         * @param cache - File contents cache or nullptr. It must outlive
+         * the handler.
+         * @param files - Open file descriptors cache or nullptr. It must
+         * outlive the handler.
+         * @param stats - Metrics reported on statsUri or nullptr.
+         * It must outlive the handler.
+         * @param statsUri - Reserved URI of the metrics page.
+         * @param pack - Bundle of the root directory or nullptr. Files found
+         * in it are served without touching the file system. It must
+         * outlive the handler.
+         */
+        request_handler(const std::string& rootDir, file_cache* cache
+                      , fd_cache* files = nullptr
+                      , const metrics* stats = nullptr
+                      , const std::string& statsUri = "/__stats"
+                      , const bundle* pack = nullptr);
+
+        /**
+         * @brief Prepare reply to a request.
+         *
+         * @param request - Parsed request. Its buffer is not referred
+         * by the response.
+         * @param memory - Arena for the reply head. It must live until
+         * the reply is sent.
+         *
+         * @return Response with a file body or 404 reply. A reply to HEAD
+         * has the head of the GET one without the body.
+         */
+        response handle(const request_view& request, arena& memory) const;
+
+        /**
+         * @brief Preload files of the root directory into the caches.
+         * Smaller files are loaded first, so most files fit into the limit.
+         *
+         * @param limit - Maximum count of bytes read into file_cache.
+         */
+        void warmUp(size_t limit) const;
+
+        const std::string& rootDir() const noexcept {
+            return m_rootDir;
+        }
+
+    private:
+        /**
+         * @brief Prepare reply to a GET or HEAD request with a body.
+         */
+        response serve(const request_view& request, arena& memory) const;
+        response makeStats(arena& memory) const;
+        fd_cache::entry_ptr openFile(const std::string& path) const;
+
+        /**
+         * @brief Prepare reply with a file of the bundle.
+         *
+         * @param path - Path relative to the root directory.
+         *
+         * @return false if the bundle has no such file.
+         */
+        bool serveBundled(const char* path, size_t size
+                        , const request_view& request
+                        , arena& memory, response& result) const;
+
+        /**
+         * @brief Prepare reply to a request with Range header with parts
+         * of a bundled file. A single range is sent from the mapping.
+         *
+         * @return false if the whole file must be sent instead.
+         */
+        bool serveBundledRanges(const bundle_entry& entry, const char* path
+                              , size_t size, const request_view& request
+                              , arena& memory, response& result) const;
+
+        /**
+         * @brief Prepare reply with a file from the caches or the disk.
+         *
+         * @return false if the file does not exist.
+         */
+        bool serveFile(const std::string& path, const char* type
+                     , content_encoding encoding, const request_view& request
+                     , arena& memory, response& result) const;
+
+        /**
+         * @brief Prepare reply to a request with Range header.
+         *
+         * @return false if the whole file must be sent instead.
+         */
+        bool serveRanges(const std::string& path, const char* type
+                       , const request_view& request, arena& memory
+                       , response& result) const;
+
+        /**
+         * @brief Prepare reply with a precompressed sibling file or with
+         * the file compressed into file_cache.
+         *
+         * @param accepted - Bit mask of encodings accepted by the client.
+         *
+         * @return false if there is no compressed variant.
+         */
+        bool serveEncoded(const std::string& path, const char* type
+                        , unsigned accepted, const request_view& request
+                        , arena& memory, response& result) const;
+
+        /**
+         * @brief Replace reply with a cached file by 304 if the client
+         * has the file.
+         */
+        void replyCached(const char* type, const request_view& request
+                       , arena& memory, response& result) const;
+
+        /**
+         * @brief Read a file into the cache under a key of encodedCacheKey().
+         */
+        bool readToCache(const std::string& key, const open_file& file
+                       , const const_buffer& head, response& result) const;
+
+    private:
+        std::string m_rootDir;
+        file_cache* m_cache;
+        fd_cache* m_files;
+        const metrics* m_stats;
+        std::string m_statsUri;
+        const bundle* m_bundle;
+};
+} // namespace http
+
+#endif /* !REQUEST_HANDLER_H */
@@ -0,0 +1,293 @@
+/*
+ * response.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "response.h"
+
+#include <cstring>
+#include <iterator>
+#include <stdio.h>
+#include <strings.h>
+#include <time.h>
+#include <utility>
+
+namespace {
+struct status_line {
+    int status;
+    const char* text;
+    size_t size;
+};
+
+#define STATUS_TEXT(status, reason) \
+    "HTTP/1.1 " #status " " reason "\r\nServer: simple_http_0_server\r\n"
+#define STATUS_LINE(status, reason) \
+    {status, STATUS_TEXT(status, reason) \
+           , sizeof(STATUS_TEXT(status, reason)) - 1}
+
+/// Status lines followed by the Server header. The last one is used for
+/// unknown codes.
+const status_line STATUS_LINES[] = {
+    STATUS_LINE(200, "OK")
+  , STATUS_LINE(206, "Partial Content")
+  , STATUS_LINE(304, "Not Modified")
+  , STATUS_LINE(404, "Not found")
+  , STATUS_LINE(416, "Range Not Satisfiable")
+  , STATUS_LINE(503, "Service Unavailable")
+  , STATUS_LINE(500, "Internal Server Error")
+};
+
+#undef STATUS_LINE
+#undef STATUS_TEXT
+
+const std::string KEEP_ALIVE_TAIL = "Connection: keep-alive\r\n\r\n";
+const std::string CLOSE_TAIL = "Connection: close\r\n\r\n";
+
+struct mime_type {
+    const char* extension;
+    const char* type;
+};
+
+char* append(char* out, const char* data, size_t size) {
+    std::memcpy(out, data, size);
+    return out + size;
+}
+
+const mime_type MIME_TYPES[] = {
+    {"html", "text/html"}, {"htm", "text/html"}, {"css", "text/css"}
+  , {"txt", "text/plain"}, {"csv", "text/csv"}, {"md", "text/markdown"}
+  , {"js", "application/javascript"}, {"mjs", "application/javascript"}
+  , {"json", "application/json"}, {"xml", "application/xml"}
+  , {"wasm", "application/wasm"}, {"pdf", "application/pdf"}
+  , {"svg", "image/svg+xml"}, {"png", "image/png"}, {"jpg", "image/jpeg"}
+  , {"jpeg", "image/jpeg"}, {"gif", "image/gif"}, {"webp", "image/webp"}
+  , {"ico", "image/x-icon"}, {"woff", "font/woff"}, {"woff2", "font/woff2"}
+};
+}
+
+namespace http {
+char* formatNumber(char* out, uint64_t value) noexcept {
+    char digits[20];
+    auto it = digits + sizeof(digits);
+    do {
+        *--it = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value);
+    return append(out, it, digits + sizeof(digits) - it);
+}
+
+constexpr size_t head_builder::MAX_SIZE;
+
+head_builder::head_builder(int status) noexcept {
+    const auto* line = std::begin(STATUS_LINES);
+    while (line + 1 != std::end(STATUS_LINES) && line->status != status)
+        ++line;
+    text(line->text, line->size);
+}
+
+head_builder& head_builder::text(const char* data, size_t size) noexcept {
+    if (size <= MAX_SIZE - m_size) {
+        std::memcpy(m_data + m_size, data, size);
+        m_size += size;
+    }
+    return *this;
+}
+
+head_builder& head_builder::number(uint64_t value) noexcept {
+    char digits[20];
+    return text(digits, formatNumber(digits, value) - digits);
+}
+
+head_builder& head_builder::add(const char* name, const char* value) noexcept {
+    return text(name, std::strlen(name)).text(": ", 2)
+          .text(value, std::strlen(value)).text("\r\n", 2);
+}
+
+head_builder& head_builder::add(const char* name
+                              , const std::string& value) noexcept {
+    return text(name, std::strlen(name)).text(": ", 2).text(value)
+          .text("\r\n", 2);
+}
+
+head_builder& head_builder::add(const char* name, uint64_t value) noexcept {
+    return text(name, std::strlen(name)).text(": ", 2).number(value)
+          .text("\r\n", 2);
+}
+
+const_buffer head_builder::finish(arena& memory) const {
+    const auto result = memory.allocate(m_size);
+    std::memcpy(result, m_data, m_size);
+    return {result, m_size};
+}
+
+std::string validatorHeaders(const std::string& etag
+                           , const std::string& lastModified) {
+    return "ETag: " + etag + "\r\nLast-Modified: " + lastModified + "\r\n";
+}
+
+const char* mimeType(const std::string& path) noexcept {
+    const auto dot = path.rfind('.');
+    const auto slash = path.rfind('/');
+    if (dot != std::string::npos
+            && (slash == std::string::npos || dot > slash)) {
+        const auto extension = path.c_str() + dot + 1;
+        for (const auto& m: MIME_TYPES) {
+            if (strcasecmp(extension, m.extension) == 0)
+                return m.type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+response::response(response&& other) noexcept
+    : head(other.head)
+    , body(std::move(other.body))
+    , mappedBody(other.mappedBody)
+    , status(other.status)
+    , keepAlive(other.keepAlive)
+    , file(other.file)
+    , openFile(std::move(other.openFile))
+    , fileOffset(other.fileOffset)
+    , fileEnd(other.fileEnd)
+    , cached(std::move(other.cached))
+    , segments(std::move(other.segments))
+    , continued(other.continued)
+    , headOnly(other.headOnly)
+    , queueTime(other.queueTime)
+    , memoryEnd(other.memoryEnd)
+{
+    other.file = INVALID_FD;
+}
+
+response& response::operator=(response&& other) noexcept {
+    if (this != &other) {
+        head = other.head;
+        body = std::move(other.body);
+        mappedBody = other.mappedBody;
+        status = other.status;
+        keepAlive = other.keepAlive;
+        file = other.file;
+        openFile = std::move(other.openFile);
+        fileOffset = other.fileOffset;
+        fileEnd = other.fileEnd;
+        cached = std::move(other.cached);
+        segments = std::move(other.segments);
+        continued = other.continued;
+        headOnly = other.headOnly;
+        queueTime = other.queueTime;
+        memoryEnd = other.memoryEnd;
+        other.file = INVALID_FD;
+    }
+    return *this;
+}
+
+size_t response::memorySize() const noexcept {
+    const auto& tail = keepAlive ? KEEP_ALIVE_TAIL : CLOSE_TAIL;
+    if (continued)
+        return body.size();
+    if (cached)
+        return cached->head.size() + tail.size()
+             + (headOnly ? 0 : cached->body.size());
+    return head.size + tail.size() + (mappedBody.data ? mappedBody.size
+                                                      : body.size());
+}
+
+size_t response::size() const noexcept {
+    auto result = memorySize() + (fileEnd - fileOffset);
+    for (const auto& s: segments)
+        result += s.prefix.size() + (s.fileEnd - s.fileOffset);
+    return result;
+}
+
+void response::omitBody() noexcept {
+    body.clear();
+    mappedBody = {nullptr, 0};
+    file = INVALID_FD;
+    openFile.reset();
+    fileOffset = fileEnd = 0;
+    segments.clear();
+    headOnly = true;
+}
+
+bool response::nextSegment() {
+    if (segments.empty())
+        return false;
+    auto& next = segments.front();
+    body = std::move(next.prefix);
+    fileOffset = next.fileOffset;
+    fileEnd = next.fileEnd;
+    continued = true;
+    segments.erase(segments.begin());
+    return true;
+}
+
+int response::pending(iovec* iov, size_t written) const noexcept {
+    const auto& tail = keepAlive ? KEEP_ALIVE_TAIL : CLOSE_TAIL;
+    const auto& content = cached && !headOnly ? cached->body : body;
+    const const_buffer parts[MAX_PARTS] = {
+        cached ? const_buffer{cached->head.data(), cached->head.size()} : head,
+        {tail.data(), tail.size()},
+        mappedBody.data ? mappedBody
+                        : const_buffer{content.data(), content.size()}
+    };
+
+    int count = 0;
+    for (auto i = continued ? MAX_PARTS - 1 : 0; i < MAX_PARTS; ++i) {
+        const auto& part = parts[i];
+        if (written >= part.size) {
+            written -= part.size;
+            continue;
+        }
+        iov[count].iov_base = const_cast<char*>(part.data + written);
+        iov[count].iov_len = part.size - written;
+        ++count;
+        written = 0;
+    }
+    return count;
+}
+
+std::string httpDate(time_t time) {
+    tm parts;
+    gmtime_r(&time, &parts);
+    char result[32];
+    const auto size = strftime(result, sizeof(result)
+                             , "%a, %d %b %Y %H:%M:%S GMT", &parts);
+    return std::string(result, size);
+}
+
+std::string entityTag(const struct stat& fileStat) {
+    char result[64];
+    snprintf(result, sizeof(result), "\"%llx-%llx-%llx\""
+           , static_cast<unsigned long long>(fileStat.st_ino)
+           , static_cast<unsigned long long>(fileStat.st_size)
+           , static_cast<unsigned long long>(fileStat.st_mtim.tv_sec)
+             * 1000000000ull + fileStat.st_mtim.tv_nsec);
+    return result;
+}
+
+bool parseHttpDate(const char* date, size_t size, time_t& result) {
+    const std::string value(date, size);
+    tm parts{};
+    const auto end = strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT"
+                            , &parts);
+    if (!end || *end != '\0')
+        return false;
+    result = timegm(&parts);
+    return true;
+}
+
+response makeNotFound() {
+    static const std::string NOT_FOUND_CONTEXT = "Not found";
+    // The head is the same for every reply, so it is made once.
+    static const std::string HEAD = head_builder(404)
+        .add("Content-Length", NOT_FOUND_CONTEXT.size())
+        .add("Content-Type", "text/html").str();
+    response result;
+    result.status = 404;
+    result.head = {HEAD.data(), HEAD.size()};
+    result.body = NOT_FOUND_CONTEXT;
+    return result;
+}
+} // namespace http
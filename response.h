@@ -0,0 +1,244 @@
+/*
+ * response.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef RESPONSE_H
+#define RESPONSE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+#include "arena.h"
+#include "fd_cache.h"
+#include "file_cache.h"
+
+namespace http {
+/**
+ * @brief Reply prepared for sending.
+ * It consists of a serialized status line with headers, a Connection header
+ * chosen per request, a small inline body and an optional file body which is
+ * sent straight from a descriptor. Instead of the head and the inline body
+ * the reply may refer to a cached file which is sent from memory.
+ * The head is not owned by the reply, it is allocated in the arena of the
+ * connection or refers to static storage or a mapped bundle.
+ * A multipart reply continues with segments, each of them is an inline
+ * prefix and a range of the same file.
+ * File descriptor is owned by a shared open_file, so it stays open while
+ * the reply is sent even if the descriptor cache drops it.
+ */
+struct response {
+    static constexpr int INVALID_FD = -1;
+    /// Maximum count of buffers returned by pending().
+    static constexpr int MAX_PARTS = 3;
+
+    struct segment {
+        std::string prefix;
+        off_t fileOffset;
+        off_t fileEnd;
+    };
+
+    response() = default;
+
+    response(response&& other) noexcept;
+    response& operator=(response&& other) noexcept;
+    response(const response&) = delete;
+    response& operator=(const response&) = delete;
+
+    /// Status line and headers without the terminating empty line.
+    const_buffer head = {nullptr, 0};
+    /// Inline body.
+    std::string body;
+    /// Body which is not owned by the reply and outlives it, e.g. a file of
+    /// a mapped bundle. It is sent instead of the inline body if set.
+    const_buffer mappedBody = {nullptr, 0};
+    /// Status code, reported to metrics.
+    int status = 200;
+    /// Keep the connection open after the reply.
+    bool keepAlive = false;
+    /// File to send after the in-memory parts.
+    int file = INVALID_FD;
+    /// Owner of the file descriptor.
+    fd_cache::entry_ptr openFile;
+    /// Offset of the first file byte to send.
+    off_t fileOffset = 0;
+    /// Offset after the last file byte to send.
+    off_t fileEnd = 0;
+    /// Cached file which head and body are sent instead of the fields above.
+    file_cache::entry_ptr cached;
+    /// Segments sent after the file part. It is a vector, because an empty
+    /// deque allocates memory.
+    std::vector<segment> segments;
+    /// Head is sent, the body and the file part belong to a segment.
+    bool continued = false;
+    /// Only the head is sent, e.g. the reply to a HEAD request.
+    bool headOnly = false;
+    /// Moment the reply was queued for sending, in metrics::now() units.
+    uint64_t queueTime = 0;
+    /// Position of the connection arena after the reply was queued, memory
+    /// before it is not needed when the reply is sent.
+    arena::mark memoryEnd = {0, 0};
+
+    /**
+     * @brief Check if there is file data to send.
+     */
+    bool hasFile() const noexcept {
+        return fileOffset < fileEnd;
+    }
+
+    /**
+     * @brief Size of the in-memory parts of the reply.
+     */
+    size_t memorySize() const noexcept;
+
+    /**
+     * @brief Size of the whole reply which is not sent yet.
+     */
+    size_t size() const noexcept;
+
+    /**
+     * @brief Drop every body part and keep the head, which still describes
+     * the body.
+     */
+    void omitBody() noexcept;
+
+    /**
+     * @brief Replace the sent body and file part with the next segment.
+     *
+     * @return false if there are no segments left.
+     */
+    bool nextSegment();
+
+    /**
+     * @brief Describe in-memory parts of the reply which are not sent yet.
+     *
+     * @param iov - Output buffers, at least MAX_PARTS.
+     * @param written - Count of in-memory bytes already sent.
+     *
+     * @return Count of filled buffers.
+     */
+    int pending(iovec* iov, size_t written) const noexcept;
+};
+
+/**
+ * @brief Format a number in decimal without a terminating zero.
+ *
+ * @param out - Output, at least 20 bytes.
+ *
+ * @return Pointer after the last written digit.
+ */
+char* formatNumber(char* out, uint64_t value) noexcept;
+
+/**
+ * @brief Writer of a reply head into a fixed buffer.
+ * The status line and the Server header are copied from a precomputed block
+ * and numbers are formatted by hand, so a head is built without heap
+ * allocations and copied into the connection arena once.
+ * Heads are made of values chosen by the server, so they are far smaller
+ * than MAX_SIZE; text which does not fit is dropped.
+ */
+class head_builder {
+    public:
+        static constexpr size_t MAX_SIZE = 1024;
+
+        /**
+         * @brief Start a head with a status line.
+         *
+         * @param status - Status code. Unknown codes are replaced by 500.
+         */
+        explicit head_builder(int status) noexcept;
+
+        head_builder(const head_builder&) = delete;
+        head_builder& operator=(const head_builder&) = delete;
+
+        /**
+         * @brief Append raw text, e.g. a precomputed block of header lines.
+         */
+        head_builder& text(const char* data, size_t size) noexcept;
+
+        head_builder& text(const std::string& data) noexcept {
+            return text(data.data(), data.size());
+        }
+
+        template <size_t N>
+        head_builder& text(const char (&literal)[N]) noexcept {
+            return text(literal, N - 1);
+        }
+
+        /**
+         * @brief Append a number in decimal.
+         */
+        head_builder& number(uint64_t value) noexcept;
+
+        /**
+         * @brief Append a header line.
+         */
+        head_builder& add(const char* name, const char* value) noexcept;
+        head_builder& add(const char* name, const std::string& value) noexcept;
+        head_builder& add(const char* name, uint64_t value) noexcept;
+
+        /**
+         * @brief Copy the head into an arena.
+         *
+         * @return Reply head without the terminating empty line.
+         */
+        const_buffer finish(arena& memory) const;
+
+        std::string str() const {
+            return std::string(m_data, m_size);
+        }
+
+    private:
+        char m_data[MAX_SIZE];
+        size_t m_size = 0;
+};
+
+/**
+ * @brief Make header lines with validators of a file.
+ * The block is made once per file and copied into every head.
+ */
+std::string validatorHeaders(const std::string& etag
+                           , const std::string& lastModified);
+
+/**
+ * @brief Get MIME type of a file by its extension.
+ * Unknown files are application/octet-stream.
+ */
+const char* mimeType(const std::string& path) noexcept;
+
+/**
+ * @brief Format time as HTTP-date, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+ */
+std::string httpDate(time_t time);
+
+/**
+ * @brief Make a strong entity tag of a file from its inode, size and
+ * modification time, so a rewritten or replaced file gets a new tag.
+ *
+ * @return Quoted tag.
+ */
+std::string entityTag(const struct stat& fileStat);
+
+/**
+ * @brief Parse HTTP-date in the preferred format.
+ *
+ * @return false if the string is not a date.
+ */
+bool parseHttpDate(const char* date, size_t size, time_t& result);
+
+/**
+ * @brief Prepare 404 reply.
+ */
+response makeNotFound();
+} // namespace http
+
+#endif /* !RESPONSE_H */
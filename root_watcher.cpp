@@ -0,0 +1,166 @@
+/*
+ * root_watcher.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "root_watcher.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <dirent.h>
+#include <initializer_list>
+#include <poll.h>
+#include <stdexcept>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compression.h"
+#include "logger.h"
+
+namespace {
+constexpr uint32_t WATCHED_EVENTS = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB
+                                  | IN_CREATE | IN_DELETE | IN_MOVED_FROM
+                                  | IN_MOVED_TO | IN_DELETE_SELF
+                                  | IN_MOVE_SELF | IN_ONLYDIR;
+
+/// Events which change the set of directories.
+constexpr uint32_t STRUCTURE_EVENTS = IN_ISDIR | IN_DELETE_SELF
+                                    | IN_MOVE_SELF;
+
+constexpr size_t EVENTS_BUFFER_SIZE = 16 * 1024;
+}
+
+namespace http {
+root_watcher::root_watcher(const std::string& rootDir, file_cache* cache
+                         , fd_cache* files)
+    : m_rootDir(rootDir)
+    , m_cache(cache)
+    , m_files(files)
+{
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify < 0)
+        throw std::runtime_error("Can't initialize inotify");
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeFd < 0) {
+        close(m_inotify);
+        throw std::runtime_error("Can't create a wake descriptor");
+    }
+
+    watchTree(m_rootDir);
+    m_thread = std::thread(&root_watcher::run, this);
+}
+
+root_watcher::~root_watcher() {
+    const uint64_t value = 1;
+    if (write(m_wakeFd, &value, sizeof(value)) < 0)
+        logger::message(log_level::error, "Can't wake root watcher: %s"
+                      , strerror(errno));
+    m_thread.join();
+    close(m_wakeFd);
+    close(m_inotify);
+}
+
+void root_watcher::run() {
+    pollfd fds[2];
+    fds[0].fd = m_inotify;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_wakeFd;
+    fds[1].events = POLLIN;
+    alignas(inotify_event) char buffer[EVENTS_BUFFER_SIZE];
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            logger::message(log_level::error, "Root watcher failed: %s"
+                          , strerror(errno));
+            return;
+        }
+        if (fds[1].revents)
+            return;
+
+        bool structureChanged = false;
+        bool overflowed = false;
+        ssize_t length;
+        while ( (length = read(m_inotify, buffer, sizeof(buffer))) > 0) {
+            for (auto p = buffer; p < buffer + length; ) {
+                const auto& event = *reinterpret_cast<const inotify_event*>(p);
+                p += sizeof(inotify_event) + event.len;
+                if (event.mask & IN_Q_OVERFLOW) {
+                    overflowed = true;
+                } else if (event.mask & IN_IGNORED) {
+                    m_dirs.erase(event.wd);
+                } else if (event.mask & STRUCTURE_EVENTS) {
+                    structureChanged = true;
+                } else if (event.len != 0) {
+                    const auto it = m_dirs.find(event.wd);
+                    if (it != m_dirs.end())
+                        invalidate(it->second + event.name);
+                }
+            }
+        }
+
+        // Directories are watched again before the caches are dropped,
+        // so files created in a new directory meanwhile are not missed.
+        if (structureChanged)
+            rewatch();
+        if (structureChanged || overflowed)
+            invalidateAll();
+    }
+}
+
+void root_watcher::watchTree(const std::string& dir) {
+    const auto wd = inotify_add_watch(m_inotify, dir.c_str(), WATCHED_EVENTS);
+    if (wd < 0) {
+        logger::message(log_level::warning, "Can't watch directory %s: %s"
+                      , dir.c_str(), strerror(errno));
+        return;
+    }
+    m_dirs[wd] = dir;
+
+    const auto d = opendir(dir.c_str());
+    if (!d)
+        return;
+    while (const auto entry = readdir(d)) {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+        const auto path = dir + name;
+        struct stat fileStat;
+        if (lstat(path.c_str(), &fileStat) == 0 && S_ISDIR(fileStat.st_mode))
+            watchTree(path + '/');
+    }
+    closedir(d);
+}
+
+void root_watcher::rewatch() {
+    for (const auto& dir: m_dirs)
+        inotify_rm_watch(m_inotify, dir.first);
+    m_dirs.clear();
+    watchTree(m_rootDir);
+}
+
+void root_watcher::invalidate(const std::string& path) {
+    logger::message(log_level::debug, "File changed: %s", path.c_str());
+    if (m_cache) {
+        for (const auto encoding: {content_encoding::identity
+                                 , content_encoding::gzip
+                                 , content_encoding::br})
+            m_cache->erase(encodedCacheKey(path, encoding));
+    }
+    if (m_files)
+        m_files->erase(path);
+}
+
+void root_watcher::invalidateAll() {
+    logger::message(log_level::info, "Root directory changed, caches dropped");
+    if (m_cache)
+        m_cache->clear();
+    if (m_files)
+        m_files->clear();
+}
+} // namespace http
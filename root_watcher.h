@@ -0,0 +1,69 @@
+/*
+ * root_watcher.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ROOT_WATCHER_H
+#define ROOT_WATCHER_H
+
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "fd_cache.h"
+#include "file_cache.h"
+
+namespace http {
+/**
+ * @brief Keeps the caches consistent with the root directory.
+ * Every directory of the tree is watched with inotify. When a file is
+ * written, replaced, removed or created, its entries are removed from the
+ * caches, so the next request reads it again. Changes of the directory
+ * structure and event queue overflows drop the whole caches.
+ */
+class root_watcher {
+    public:
+        /**
+         * @brief Watch a directory tree and start the watcher thread.
+         *
+         * @param rootDir - Root directory ending with '/'. Cache keys are
+         * this path followed by a relative file path.
+         * @param cache - File contents cache or nullptr.
+         * @param files - Open file descriptors cache or nullptr.
+         * Caches must outlive the watcher.
+         */
+        root_watcher(const std::string& rootDir, file_cache* cache
+                   , fd_cache* files) noexcept(false);
+
+        /**
+         * @brief Stop the watcher thread.
+         */
+        ~root_watcher();
+
+        root_watcher(const root_watcher&) = delete;
+        root_watcher& operator=(const root_watcher&) = delete;
+
+    private:
+        void run();
+        void watchTree(const std::string& dir);
+        void rewatch();
+        void invalidate(const std::string& path);
+        void invalidateAll();
+
+    private:
+        static constexpr int INVALID_FD = -1;
+
+        std::string m_rootDir;
+        file_cache* m_cache;
+        fd_cache* m_files;
+        int m_inotify = INVALID_FD;
+        int m_wakeFd = INVALID_FD;
+        /// Watched directories by watch descriptor, paths end with '/'.
+        std::unordered_map<int, std::string> m_dirs;
+        std::thread m_thread;
+};
+} // namespace http
+
+#endif /* !ROOT_WATCHER_H */
@@ -9,209 +9,170 @@
 
 #include <algorithm>
 #include <arpa/inet.h>
-#include <future>
-#include <fstream>
+#include <cerrno>
+#include <fcntl.h>
 #include <iostream>
-#include <memory>
 #include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdexcept>
-#include <stdio.h>
 #include <string.h>
 #include <strings.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
-#include "boost_parser/request_parser.hpp"
 #include "common.h"
-#include "optional.h"
+#include "event_loop.h"
+#include "handover.h"
+#include "logger.h"
+#include "uring_loop.h"
 
 namespace {
-template <typename S>
-inline S& operator<<(S& s, const http::header& h) {
-    return s << h.name << ": " << h.value;
-}
-
-template <typename S, typename T>
-inline S& operator<<(S& s, const std::vector<T>& v) {
-    std::for_each(v.begin(), v.end(), [&s](const T& t) {
-        s << t << ' ';
-    });
-
-    return s << std::endl;
-}
-
-template <typename S>
-inline S& operator<<(S& s, const http::request& request) {
-    return s << request.method << " HTTP/" << request.http_version_major << '.'
-      << request.http_version_minor
-      << std::endl << "URI=" << request.uri << std::endl << request.headers;
-}
+/// Time in milliseconds a new process may take to start, it may warm up
+/// its caches.
+constexpr unsigned START_TIMEOUT = 60000;
 
 inline sockaddr* sockaddrCast(sockaddr_in* v) {
     return reinterpret_cast<sockaddr*>(v);
 }
 
-void shutdownSock(int sock) {
-    shutdown(sock, SHUT_RDWR);
-    close(sock);
-}
-
-optional<std::string> parseUri(const std::string& uri) {
-    if (uri.empty() || uri.front() != '/'
-            || uri.find("..") != std::string::npos) {
-        std::cerr << "Invalid URI \"" << uri << '\"' << std::endl;
-        return nothing<std::string>();
-    }
-
-    std::string result;
-    result.reserve(uri.size());
-    for (auto i = std::string::size_type(1); i < uri.size(); ++i) {
-        const auto& ch = uri[i];
-        if (ch == '%') {
-            std::cerr << "Internationalized URI is not supported" << std::endl;
-            return nothing<std::string>();
-        }
-
-        static const std::set<char> STOP_SYMBOLS = { '&', ';', '?' };
-        static const auto END_IT  = STOP_SYMBOLS.end();
-        if (STOP_SYMBOLS.find(ch) != END_IT) {
-            break;
-        }
-        result += ch;
-    }
-
-    if (result.empty() || result.back() == '/')
-        result += "index.html";
-    return just(std::move(result));
-}
-
-static constexpr char CRLF[] = {'\r', '\n'};
+/**
+ * @brief Create a listening socket bound with SO_REUSEPORT, so several
+ * sockets may share one address.
+ *
+ * @param sock - Address to bind.
+ * @param backlog - Length of the queue of clients not accepted yet.
+ *
+ * @return Listening socket.
+ */
+int createListenSocket(sockaddr_in& sock, int backlog) {
+    int listenSocket = -1;
+    const auto shutdownOnError = [&listenSocket] {
+        listenSocket >= 0 ? void(shutdownSock(listenSocket)) : void();
+        throw std::runtime_error("Can't construct a server");
+    };
 
-void replyContents(int clientSocket, int status, const std::string& statusStr
-    , const std::vector<http::header>& headers, const std::string& content) {
+    listenSocket = callStdlibFunc(shutdownOnError, socket, AF_INET
+                                , SOCK_STREAM | SOCK_CLOEXEC, 0);
 
-    std::stringstream writeStringStream;
-    writeStringStream << "HTTP/1.0 " << status << ' ' << statusStr << CRLF;
-    for (const auto& header: headers) {
-        writeStringStream << header.name << ": " << header.value << CRLF;
-    }
-    writeStringStream << CRLF << content;
-
-    const auto& writeStr = writeStringStream.str();
-    std::cout << "Reply str: " << writeStr << std::endl;
-    size_t writed = 0;
-    while (writed < writeStr.size()) {
-        writed = callStdlibFunc([]{}, write, clientSocket
-                              , writeStr.c_str() + writed
-                              , writeStr.size() - writed);
-    }
+    const int enable = 1;
+    callStdlibFunc(shutdownOnError, setsockopt, listenSocket, SOL_SOCKET
+                 , SO_REUSEPORT, &enable, sizeof(enable));
+    callStdlibFunc(shutdownOnError, bind, listenSocket
+                 , sockaddrCast(&sock), sizeof(sockaddr_in));
+    callStdlibFunc(shutdownOnError, listen, listenSocket, backlog);
+    return listenSocket;
 }
 
-std::vector<http::header> getHeaders(size_t contentSize) {
-    std::vector<http::header> headers;
-    headers.push_back({"Content-Length", std::to_string(contentSize)});
-    headers.push_back({"Content-Type", "text/html"});
-    return headers;
+unsigned getWorkersCount(const http::server_options& options) {
+    const auto count = options.workers
+                     ? options.workers
+                     : std::max(1u, std::thread::hardware_concurrency());
+    // Closing an inherited socket would drop clients in its backlog.
+    return std::max(count
+                  , static_cast<unsigned>(options.listenSockets.size()));
 }
 
-void replyNotFound(int clientSocket) {
-    static const std::string NOT_FOUND_CONTEXT = "Not found";
-    replyContents(clientSocket, 404, "Not found"
-                , getHeaders(NOT_FOUND_CONTEXT.size()), NOT_FOUND_CONTEXT);
+/**
+ * @brief Get a share of a limit of all workers, at least one if the limit
+ * is enabled.
+ */
+size_t workerShare(size_t limit, size_t workers) {
+    return (limit + workers - 1) / workers;
 }
 
-void reply(int clientSocket, const http::request& request
-         , const std::string& dir) {
-    if (request.method != "GET") {
-        std::cerr << "Method " << request.method
-            << " is not supported" << std::endl;
-        replyNotFound(clientSocket);
-        return shutdownSock(clientSocket);
-    }
-
-    auto maybeRequestFile = parseUri(request.uri);
-    if (!maybeRequestFile) {
-        std::cerr << "Can't parse URI: " << request.uri << std::endl;
-        return replyNotFound(clientSocket);
+void pinThread(std::thread& thread, unsigned cpu) {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    const auto error = pthread_setaffinity_np(thread.native_handle()
+                                            , sizeof(cpuSet), &cpuSet);
+    if (error != 0) {
+        http::logger::message(http::log_level::warning
+                            , "Can't pin worker thread to CPU %u: %s", cpu
+                            , strerror(error));
     }
-
-    const auto requestFile = dir + maybeRequestFile.take();
-    std::string buffer;
-
-    {
-        static const auto FD_DELETER = [](FILE* fd) {
-            if (fd) fclose(fd); };
-        const auto fd = std::unique_ptr<FILE, decltype(FD_DELETER)>(
-                fopen(requestFile.c_str(), "r"), FD_DELETER);
-        if (fd <= 0) {
-            std::cerr << "Can't open file: " << requestFile << std::endl;
-            return replyNotFound(clientSocket);
-        }
-
-        constexpr size_t SIZE = 65534;
-        char bufStr[SIZE + 1] = {0};
-        while (fread(bufStr, sizeof(char), SIZE - 1, fd.get())) {
-            bufStr[SIZE] = 0;
-            buffer += bufStr;
-        }
-    }
-
-    replyContents(clientSocket, 200, "OK", getHeaders(buffer.size()), buffer);
+}
 }
 
-void handleConnection(int clientSocket, const std::string& dir) {
-    constexpr size_t BUF_SIZE = 65535;
-    char buffer[BUF_SIZE];
-    bzero(buffer, BUF_SIZE);
-    while (true) {
-        const auto bytesRead = callStdlibFunc([]{}, read, clientSocket
-                , buffer, BUF_SIZE);
-        if (bytesRead <= 0) {
-            std::cerr << "Can't read request from client" << std::endl;
-            break;
-        }
-
-        http::request request;
-        http::request_parser parser;
-        const auto parseResult = std::get<0>(parser.parse(request, buffer
-                                           , buffer + BUF_SIZE));
-        if (parseResult == http::request_parser::good) {
-            std::cout << "Request was accepted: " << request << std::endl;
-            reply(clientSocket, request, dir);
-            break;
-        }
-        else if (parseResult == http::request_parser::bad) {
-            std::cerr << "Bad request: " << std::endl << buffer << std::endl;
-            break;
-        }
-    }
-
-    replyNotFound(clientSocket);
-    shutdownSock(clientSocket);
+namespace http {
+bool parseEngine(const std::string& name, io_engine& engine) {
+    if (name == "epoll")
+        engine = io_engine::epoll;
+    else if (name == "uring")
+        engine = io_engine::uring;
+    else
+        return false;
+    return true;
 }
+
+const char* engineName(io_engine engine) noexcept {
+    return engine == io_engine::uring ? "uring" : "epoll";
 }
 
-namespace http {
 std::mutex server::instancesMutex;
 std::set<server*> server::serverInstances;
+int server::signalPipe[2] = {INVALID_SOCK, INVALID_SOCK};
+std::thread server::dispatcher;
 
 server::server(const std::string& address, short port
-             , const std::string& rootDir)
-    : m_rootDir(rootDir.empty()
+             , const std::string& rootDir, const server_options& options)
+    : m_bundle(options.bundlePath.empty()
+               ? nullptr
+               : new bundle(options.bundlePath, options.bundlePopulate))
+    , m_cache(options.cacheSize ? new file_cache(options.cacheSize) : nullptr)
+    , m_files(options.fdCacheSize
+              ? new fd_cache(options.fdCacheSize
+                           , options.fdCacheValidity * uint64_t(1000000))
+              : nullptr)
+    , m_stats(getWorkersCount(options))
+    , m_handler(rootDir.empty()
                 ? "./"
                 : rootDir.back() != '/'
                     ? rootDir + '/'
-                    : rootDir)
+                    : rootDir
+              , m_cache.get()
+              , m_files.get()
+              , options.statsUri.empty() ? nullptr : &m_stats
+              , options.statsUri
+              , m_bundle.get())
+    , m_restartCommand(options.restartCommand)
+    , m_drainTimeout(options.drainTimeout)
 {
+    static std::once_flag signalPipeCreated;
+    std::call_once(signalPipeCreated, [] {
+        // The handler never blocks, the dispatcher waits for signals.
+        if (pipe2(signalPipe, O_CLOEXEC) < 0
+                || fcntl(signalPipe[1], F_SETFL, O_NONBLOCK) < 0)
+            throw std::runtime_error("Can't create a signal pipe");
+    });
+    if (pipe2(m_signalPipe, O_CLOEXEC | O_NONBLOCK) < 0)
+        throw std::runtime_error("Can't create a signal pipe");
     signal(SIGINT, server::sigHandler);
-    const auto shutdownOnError = [this] {
-        m_socket != INVALID_SOCK ? void(shutdownSock(m_socket)) : void();
-        throw std::runtime_error("Can't construct a server");
-    };
-
-    m_socket = callStdlibFunc(shutdownOnError, socket, AF_INET, SOCK_STREAM, 0);
+    signal(SIGTERM, server::sigHandler);
+    signal(SIGUSR2, server::sigHandler);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (options.watchRoot && (m_cache || m_files)) {
+        try {
+            m_watcher.reset(new root_watcher(m_handler.rootDir(), m_cache.get()
+                                           , m_files.get()));
+        } catch (const std::exception& ex) {
+            logger::message(log_level::warning
+                          , "%s, cached files are not invalidated"
+                          , ex.what());
+        }
+    }
+    if (options.warmupSize)
+        m_handler.warmUp(options.warmupSize);
+    if (m_bundle) {
+        logger::message(log_level::info, "Bundle %s has %zu files"
+                      , options.bundlePath.c_str(), m_bundle->count());
+    }
 
     sockaddr_in sock;
     bzero(&sock, sizeof(sock));
@@ -220,59 +181,236 @@ server::server(const std::string& address, short port
         std::cerr << "Не удалось преобразовать адрес \""
                   << address << "\" в IP." << std::endl;
     }
-
     sock.sin_port = htons(port);
-    callStdlibFunc(shutdownOnError, bind, m_socket
-                 , sockaddrCast(&sock), sizeof(sockaddr_in));
 
-    callStdlibFunc(shutdownOnError, listen, m_socket, SOMAXCONN);
+    const auto cpuCount = std::max(1u, std::thread::hardware_concurrency());
+    m_workers.resize(getWorkersCount(options));
+    m_engine = options.engine;
+    connection_timeouts timeouts;
+    timeouts.header = options.headerTimeout * uint64_t(1000000);
+    timeouts.send = options.sendTimeout * uint64_t(1000000);
+    timeouts.idle = options.idleTimeout * uint64_t(1000000);
+    admission_limits limits;
+    limits.connections = workerShare(options.maxConnections, m_workers.size());
+    limits.requests = workerShare(options.maxRequests, m_workers.size());
+    limits.target = options.queueTarget * uint64_t(1000000);
+    limits.interval = options.queueInterval * uint64_t(1000000);
+    limits.retryAfter = options.retryAfter;
+    try {
+        for (size_t i = 0; i < m_workers.size(); ++i) {
+            auto& w = m_workers[i];
+            w.socket = i < options.listenSockets.size()
+                     ? options.listenSockets[i]
+                     : createListenSocket(sock, options.listenBacklog);
+            if (m_engine == io_engine::uring) {
+                try {
+                    w.loop.reset(new uring_loop(w.socket, m_handler
+                                              , m_stats.shard(i), timeouts
+                                              , limits));
+                    continue;
+                } catch (const std::exception& ex) {
+                    logger::message(log_level::warning
+                                  , "%s, falling back to epoll", ex.what());
+                    m_engine = io_engine::epoll;
+                }
+            }
+            w.loop.reset(new event_loop(w.socket, m_handler
+                                      , m_stats.shard(i), timeouts
+                                      , limits));
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        stopWorkers();
+        throw std::runtime_error("Can't construct a server");
+    }
 
     {
         std::lock_guard<std::mutex> lock(instancesMutex);
+        if (serverInstances.empty())
+            dispatcher = std::thread(&server::dispatchSignals);
         serverInstances.insert(this);
     }
-    m_thread = std::thread(&server::acceptConnections, this);
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        auto& w = m_workers[i];
+        w.thread = std::thread(&io_loop::run, w.loop.get());
+        if (options.pinWorkers)
+            pinThread(w.thread, i % cpuCount);
+    }
+    m_control = std::thread(&server::control, this);
 }
 
 server::~server() {
-    shutdownSock(m_socket);
+    bool last;
     {
         std::lock_guard<std::mutex> lock(instancesMutex);
         serverInstances.erase(this);
+        last = serverInstances.empty();
     }
-    joinToAcceptorThread();
+    if (last) {
+        // The dispatcher takes the lock, so it is joined without it.
+        sigHandler(0);
+        dispatcher.join();
+    }
+    stopWorkers();
 }
 
 void server::sigHandler(int sig) {
-    if (sig == SIGINT) {
+    // Only async-signal-safe write(2) is called here, servers are found by
+    // the dispatcher.
+    const auto savedErrno = errno;
+    const auto result = write(signalPipe[1], &sig, sizeof(sig));
+    static_cast<void>(result);
+    errno = savedErrno;
+}
+
+void server::dispatchSignals() {
+    int sig;
+    while (true) {
+        const auto result = read(signalPipe[0], &sig, sizeof(sig));
+        if (result < 0 && errno == EINTR)
+            continue;
+        // Zero is written when the last server is destroyed.
+        if (result != sizeof(sig) || sig == 0)
+            return;
         std::lock_guard<std::mutex> lock(instancesMutex);
-        for (server* obj: serverInstances)
-            obj->sigintHandler();
+        for (server* obj: serverInstances) {
+            if (sig == SIGINT)
+                obj->sigintHandler();
+            else
+                obj->notify(sig);
+        }
     }
 }
 
 void server::sigintHandler() {
-    shutdownSock(m_socket);
+    for (auto& w: m_workers) {
+        if (w.loop)
+            w.loop->stop();
+    }
 }
 
-void server::acceptConnections() const {
-    sockaddr_in sock;
-    socklen_t sockSize = sizeof(sockaddr_in);
+void server::notify(int sig) noexcept {
+    // The pipe is non-blocking, so a stalled control thread does not block
+    // the dispatcher.
+    const auto result = write(m_signalPipe[1], &sig, sizeof(sig));
+    static_cast<void>(result);
+}
+
+void server::control() {
+    bool draining = false;
+    uint64_t deadline = 0;
     while (true) {
-        const auto clientSocket = callStdlibFunc([] {/*nothing*/}
-            , accept, m_socket, sockaddrCast(&sock), &sockSize);
-        if (clientSocket < 0 && clientSocket != EAGAIN)
-            break;
-
-        std::cout << "Connected client: " << sock.sin_addr.s_addr << std::endl;
-        std::async(std::launch::async, handleConnection
-                 , clientSocket, m_rootDir);
+        int timeout = -1;
+        if (deadline) {
+            const auto now = metrics::now();
+            if (now >= deadline) {
+                logger::message(log_level::warning
+                              , "Drain timeout passed, dropping connections");
+                sigintHandler();
+                deadline = 0;
+                continue;
+            }
+            timeout = (deadline - now + 999999) / 1000000;
+        }
+
+        pollfd fd = {m_signalPipe[0], POLLIN, 0};
+        const auto result = poll(&fd, 1, timeout);
+        if (result < 0 && errno != EINTR) {
+            logger::message(log_level::error, "Can't wait for signals: %s"
+                          , strerror(errno));
+            return;
+        }
+        int sig;
+        while (result > 0
+                && read(m_signalPipe[0], &sig, sizeof(sig)) == sizeof(sig)) {
+            if (sig == 0)
+                return;
+            if (draining || (sig == SIGUSR2 && !handOver()))
+                continue;
+            draining = true;
+            drainWorkers();
+            deadline = metrics::now() + m_drainTimeout * uint64_t(1000000);
+        }
     }
 }
 
-void server::joinToAcceptorThread() {
-    if (m_thread.joinable())
-        m_thread.join();
+bool server::handOver() {
+    if (m_restartCommand.empty()) {
+        logger::message(log_level::warning, "Restart command is not set");
+        return false;
+    }
+
+    std::vector<int> sockets;
+    for (const auto& w: m_workers)
+        sockets.push_back(w.socket);
+    int channel = INVALID_SOCK;
+    pid_t pid = -1;
+    bool ready = false;
+    try {
+        pid = spawnSuccessor(m_restartCommand, channel);
+        sendSockets(channel, sockets);
+        ready = waitReady(channel, START_TIMEOUT);
+        if (!ready)
+            logger::message(log_level::error, "New server did not start");
+    } catch (const std::exception& ex) {
+        logger::message(log_level::error, "%s", ex.what());
+    }
+    if (channel != INVALID_SOCK)
+        close(channel);
+    if (pid > 0) {
+        // The new server daemonizes before it reports ready, so the process
+        // is exiting by now. One that did not answer is killed, otherwise
+        // the wait could block the control thread for good.
+        if (!ready)
+            kill(pid, SIGKILL);
+        pid_t result;
+        do {
+            result = waitpid(pid, nullptr, 0);
+        } while (result < 0 && errno == EINTR);
+    }
+
+    if (!ready) {
+        logger::message(log_level::error, "Restart is cancelled");
+        return false;
+    }
+    logger::message(log_level::info
+                  , "Listening sockets are handed over to a new server");
+    return true;
 }
-} // namespace http
 
+void server::drainWorkers() {
+    for (auto& w: m_workers) {
+        if (w.loop)
+            w.loop->drain();
+    }
+}
+
+void server::stopWorkers() {
+    if (m_control.joinable()) {
+        notify(0);
+        m_control.join();
+    }
+    sigintHandler();
+    joinWorkers();
+    for (auto& w: m_workers) {
+        w.loop.reset();
+        // A socket may be shared with a restarted server, shutdown() would
+        // stop its listener too.
+        if (w.socket != INVALID_SOCK)
+            close(w.socket);
+        w.socket = INVALID_SOCK;
+    }
+    for (auto& fd: m_signalPipe) {
+        if (fd != INVALID_SOCK)
+            close(fd);
+        fd = INVALID_SOCK;
+    }
+}
+
+void server::joinWorkers() {
+    for (auto& w: m_workers) {
+        if (w.thread.joinable())
+            w.thread.join();
+    }
+}
+} // namespace http
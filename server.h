@@ -8,18 +8,118 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <memory>
 #include <mutex>
 #include <set>
 #include <string>
+#include <sys/socket.h>
 #include <thread>
+#include <vector>
 
-#include "boost_parser/request.hpp"
+#include "bundle.h"
+#include "fd_cache.h"
+#include "file_cache.h"
+#include "io_loop.h"
+#include "metrics.h"
+#include "request_handler.h"
+#include "root_watcher.h"
 
 namespace http {
+enum class io_engine {
+    /// Readiness based event_loop.
+    epoll,
+    /// Completion based uring_loop. Falls back to epoll if unsupported.
+    uring
+};
+
+/**
+ * @brief Parse an engine name: epoll or uring.
+ *
+ * @return false if the name is unknown.
+ */
+bool parseEngine(const std::string& name, io_engine& engine);
+
+/**
+ * @brief Get an engine name.
+ */
+const char* engineName(io_engine engine) noexcept;
+
+/**
+ * @brief Tunable server parameters.
+ */
+struct server_options {
+    /// Number of worker threads. Zero means one worker per CPU.
+    unsigned workers = 1;
+    /// Pin each worker thread to its own CPU.
+    bool pinWorkers = false;
+    /// Memory budget of the file contents cache in bytes. Zero disables it.
+    size_t cacheSize = 32 * 1024 * 1024;
+    /// Count of cached open file descriptors, missing files included.
+    /// Zero disables the descriptor cache.
+    size_t fdCacheSize = 256;
+    /// Lifetime of a cached descriptor in milliseconds.
+    unsigned fdCacheValidity = 1000;
+    /// Invalidate cached files when they change on disk.
+    bool watchRoot = true;
+    /// Bytes of root directory files preloaded at start. Zero disables it.
+    size_t warmupSize = 0;
+    /// Reserved URI of the metrics page in Prometheus text format.
+    /// Empty string disables it.
+    std::string statsUri = "/__stats";
+    /// Time to receive a whole request in milliseconds since its first
+    /// byte. Zero disables the deadline here and below.
+    unsigned headerTimeout = 10000;
+    /// Time a reply may wait for the client to read any part of it.
+    unsigned sendTimeout = 30000;
+    /// Time an idle keep-alive connection is kept open.
+    unsigned idleTimeout = 15000;
+    /// I/O engine of worker threads.
+    io_engine engine = io_engine::epoll;
+    /// Bundle made by packBundle() which is looked up before the root
+    /// directory. Empty string disables it.
+    std::string bundlePath;
+    /// Read the bundle into memory at start and ask for huge pages.
+    bool bundlePopulate = false;
+    /// Length of the queue of clients not accepted yet, per worker.
+    int listenBacklog = SOMAXCONN;
+    /// Open client connections of all workers, they are split evenly
+    /// between workers. Zero disables the limit here and below.
+    size_t maxConnections = 0;
+    /// Requests of all workers which replies are not completely sent.
+    size_t maxRequests = 0;
+    /// Queue delay in milliseconds workers try to stay under by answering
+    /// requests with 503. Zero disables shedding by delay.
+    unsigned queueTarget = 0;
+    /// Time in milliseconds the queue delay may stay above the target
+    /// before requests are shed, see admission.
+    unsigned queueInterval = 100;
+    /// Seconds in Retry-After of 503 replies.
+    unsigned retryAfter = 1;
+    /// Time in milliseconds connections may take to finish their replies
+    /// on SIGTERM or SIGUSR2, then they are dropped.
+    unsigned drainTimeout = 30000;
+    /// Program and arguments started on SIGUSR2 to take over the
+    /// listening sockets. Empty vector disables restarts.
+    std::vector<std::string> restartCommand;
+    /// Listening sockets received from a restarted server, see handover.h.
+    /// Workers use them instead of new sockets, so there are at least as
+    /// many workers as sockets.
+    std::vector<int> listenSockets;
+};
+
 /**
  * @brief Simple HTTP 1.0 server class.
- * It listen for clients on a port and asynchronous accept connections.
- * It is possible to join to server thread which accept connections.
+ * It listen for clients on a port with a set of worker threads.
+ * Each worker owns a SO_REUSEPORT listening socket and an epoll event loop,
+ * so the kernel spreads incoming connections between them.
+ * It is possible to join to server worker threads.
+ * SIGINT stops workers at once. SIGTERM drains them: they stop accepting,
+ * finish requests in progress and return when all connections are closed
+ * or the drain timeout passes. SIGUSR2 starts a new server process, hands
+ * it the listening sockets and drains the workers when it is ready.
+ * The signal handler only writes the signal number into a pipe, a
+ * dispatcher thread passes it to every server and the control thread of
+ * a server acts on it.
  */
 class server {
     public:
@@ -29,30 +129,67 @@ class server {
          * @param address - Internet address.
          * @param port - Connection port.
          * @param rootDir - Root directory. Server will send requested files from it.
+         * @param options - Server parameters.
          */
         server(const std::string& address, short port
-             , const std::string& rootDir) noexcept(false);
+             , const std::string& rootDir
+             , const server_options& options = server_options()) noexcept(false);
         ~server();
 
         /**
-         * @brief Join to server thread.
+         * @brief Join to server worker threads.
          */
-        void joinToAcceptorThread();
+        void joinWorkers();
+
+        /**
+         * @brief Engine used by workers. It differs from the requested one
+         * if io_uring is not supported.
+         */
+        io_engine engine() const noexcept {
+            return m_engine;
+        }
 
     private:
         static void sigHandler(int sig);
+        static void dispatchSignals();
         static std::mutex instancesMutex;
         static std::set<server*> serverInstances;
+        /// Self-pipe of the signal handler, it is created once.
+        static int signalPipe[2];
+        /// Thread which passes signals from the pipe to the servers. It
+        /// runs while any server exists.
+        static std::thread dispatcher;
 
     private:
         void sigintHandler();
-        void acceptConnections() const;
+        void notify(int sig) noexcept;
+        void control();
+        bool handOver();
+        void drainWorkers();
+        void stopWorkers();
 
     private:
         static constexpr int INVALID_SOCK = -1;
-        int m_socket = INVALID_SOCK;
-        std::string m_rootDir;
-        std::thread m_thread;
+
+        struct worker {
+            int socket = INVALID_SOCK;
+            std::unique_ptr<io_loop> loop;
+            std::thread thread;
+        };
+
+        std::unique_ptr<bundle> m_bundle;
+        std::unique_ptr<file_cache> m_cache;
+        std::unique_ptr<fd_cache> m_files;
+        metrics m_stats;
+        request_handler m_handler;
+        std::unique_ptr<root_watcher> m_watcher;
+        std::vector<worker> m_workers;
+        io_engine m_engine;
+        const std::vector<std::string> m_restartCommand;
+        const unsigned m_drainTimeout;
+        /// Signals for the control thread, zero stops it.
+        int m_signalPipe[2] = {INVALID_SOCK, INVALID_SOCK};
+        std::thread m_control;
 };
 } // namespace http
 
@@ -0,0 +1,135 @@
+/*
+ * byte_range_test.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+/*
+ * Test of parseRanges: suffix and open ranges, numbers too long for off_t,
+ * MAX_RANGES, stray commas and whitespace, unsatisfiable and ignored
+ * headers. Every case is checked and failures are printed.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "byte_range.h"
+
+namespace {
+using http::range_status;
+
+const char* statusName(range_status status) {
+    switch (status) {
+        case range_status::ignored: return "ignored";
+        case range_status::satisfiable: return "satisfiable";
+        default: return "unsatisfiable";
+    }
+}
+
+/**
+ * @brief Parse a header value and compare the result with the expected one.
+ *
+ * @param expected - Expected ranges, "first-last" separated by commas.
+ *
+ * @return false on a mismatch, which is printed.
+ */
+bool check(const std::string& value, off_t fileSize, range_status status
+         , const std::string& expected = "") {
+    std::vector<http::byte_range> ranges;
+    const auto result = http::parseRanges(value.data(), value.size()
+                                        , fileSize, ranges);
+    // Ranges of an ignored header are not used.
+    std::string actual;
+    for (const auto& r: result != range_status::ignored ? ranges
+                       : std::vector<http::byte_range>()) {
+        if (r.first < 0 || r.last < r.first || r.last >= fileSize) {
+            actual = "range outside of the file";
+            break;
+        }
+        if (!actual.empty())
+            actual += ',';
+        actual += std::to_string(r.first) + '-' + std::to_string(r.last);
+    }
+    if (result == status && actual == expected)
+        return true;
+    fprintf(stderr, "\"%s\" of %lld bytes: got %s \"%s\", expected %s \"%s\"\n"
+          , value.c_str(), static_cast<long long>(fileSize)
+          , statusName(result), actual.c_str(), statusName(status)
+          , expected.c_str());
+    return false;
+}
+
+/**
+ * @brief Make count ranges of one byte, "0-0,1-1,...".
+ */
+std::string oneByteRanges(size_t count) {
+    std::string result;
+    for (size_t i = 0; i < count; ++i)
+        result += (i ? "," : "") + std::to_string(i) + '-' + std::to_string(i);
+    return result;
+}
+}
+
+int main() {
+    const auto S = range_status::satisfiable;
+    const auto U = range_status::unsatisfiable;
+    const auto I = range_status::ignored;
+    const std::string LONG_NUMBER = "99999999999999999999999999999";
+
+    bool ok = true;
+    // Plain, open and suffix ranges.
+    ok &= check("bytes=0-99", 1000, S, "0-99");
+    ok &= check("BYTES=0-0", 1000, S, "0-0");
+    ok &= check("bytes=500-", 1000, S, "500-999");
+    ok &= check("bytes=999-", 1000, S, "999-999");
+    ok &= check("bytes=900-5000", 1000, S, "900-999");
+    ok &= check("bytes=-100", 1000, S, "900-999");
+    ok &= check("bytes=-2000", 1000, S, "0-999");
+    ok &= check("bytes=0-1,5-9,-1", 1000, S, "0-1,5-9,999-999");
+    // Numbers longer than off_t are clipped, never negative.
+    ok &= check("bytes=0-" + LONG_NUMBER, 1000, S, "0-999");
+    ok &= check("bytes=-" + LONG_NUMBER, 1000, S, "0-999");
+    ok &= check("bytes=11529215046068469760-", 1000, U);
+    ok &= check("bytes=" + LONG_NUMBER + "-", 1000, U);
+    ok &= check("bytes=" + LONG_NUMBER + "-" + LONG_NUMBER, 1000, U);
+    ok &= check("bytes=9223372036854775807-", 1000, U);
+    // 416: no range overlaps the file.
+    ok &= check("bytes=1000-", 1000, U);
+    ok &= check("bytes=1000-1001,2000-", 1000, U);
+    ok &= check("bytes=-0", 1000, U);
+    ok &= check("bytes=0-", 0, U);
+    ok &= check("bytes=-5", 0, U);
+    ok &= check("bytes=1000-,0-0", 1000, S, "0-0");
+    // MAX_RANGES.
+    ok &= check("bytes=" + oneByteRanges(http::MAX_RANGES), 1000, S
+              , oneByteRanges(http::MAX_RANGES));
+    ok &= check("bytes=" + oneByteRanges(http::MAX_RANGES + 1), 1000, I);
+    // Commas and whitespace.
+    ok &= check("bytes=0-1,", 1000, S, "0-1");
+    ok &= check("bytes=,0-1", 1000, S, "0-1");
+    ok &= check("bytes= 0-1 ,\t2-3\t, ,", 1000, S, "0-1,2-3");
+    ok &= check("bytes=,", 1000, I);
+    ok &= check("bytes=", 1000, I);
+    ok &= check("bytes= ", 1000, I);
+    // Malformed headers are ignored, the whole file is sent.
+    ok &= check("items=0-1", 1000, I);
+    ok &= check("bytes", 1000, I);
+    ok &= check("bytes=5-1", 1000, I);
+    ok &= check("bytes=a-1", 1000, I);
+    ok &= check("bytes=1-a", 1000, I);
+    ok &= check("bytes=1", 1000, I);
+    ok &= check("bytes=1-2-3", 1000, I);
+    ok &= check("bytes=-", 1000, I);
+    ok &= check("bytes=--1", 1000, I);
+    ok &= check("bytes=0 - 1", 1000, I);
+    ok &= check("bytes=0-1,x", 1000, I);
+
+    if (!ok)
+        return EXIT_FAILURE;
+    printf("All Range cases passed\n");
+    return EXIT_SUCCESS;
+}
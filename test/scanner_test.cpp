@@ -0,0 +1,180 @@
+/*
+ * scanner_test.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+/*
+ * Differential test of the run scanners. Every request is parsed byte by
+ * byte through a non-pointer iterator, which never skips runs, and then
+ * with every scanner the CPU supports, whole and split into reads at fixed
+ * pseudo-random points. Results, consumed lengths and slices must be the
+ * same. Requests are built-in samples and their deterministic mutations.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "boost_parser/request_parser.hpp"
+#include "boost_parser/request_view.hpp"
+#include "boost_parser/scanner.hpp"
+
+namespace {
+/// Mutations of every sample.
+constexpr int MUTATIONS = 4000;
+
+struct parse_result {
+    http::request_parser::result_type result;
+    size_t consumed;
+    http::request_view view;
+};
+
+/**
+ * @brief Samples with runs longer than one SIMD step and bytes which end
+ * them at different offsets.
+ */
+std::vector<std::string> makeSamples() {
+    const std::string longPath(100, 'a');
+    const std::string longValue(70, 'v');
+    return {
+        "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n",
+        "HEAD /index.html HTTP/1.0\r\nAccept: */*\r\n folded\r\n\r\n",
+        "GET /" + longPath + "?q=" + longPath + " HTTP/1.1\r\n"
+            "X-Long-Header-Name-Over-Thirty-Two-Bytes: " + longValue + "\r\n"
+            "User-Agent: Mozilla/5.0 (X11; Linux x86_64)\r\n\r\n",
+        "GET /" + longPath + "\x01 HTTP/1.1\r\n\r\n",
+        "GET / HTTP/1.1\r\nValue: " + longValue + "\x7f" + "\r\n\r\n",
+        "GET / HTTP/1.1\r\nHigh: caf\xc3\xa9 " + longValue + "\r\n\r\n",
+        "G\xc3T / HTTP/1.1\r\n\r\n",
+        "GET / HTTP/1.1\r\nName-" + longValue + "@: x\r\n\r\n",
+        "POST /form HTTP/1.1\r\nContent-Length: 0\r\n\r\nGET / HTTP/1.1",
+    };
+}
+
+/**
+ * @brief Parse byte by byte, the scanners are not used.
+ */
+parse_result parseReference(const std::string& input) {
+    parse_result r;
+    http::request_parser parser;
+    const auto result = parser.parse(r.view, input.begin(), input.end());
+    r.result = std::get<0>(result);
+    r.consumed = std::get<1>(result) - input.begin();
+    return r;
+}
+
+/**
+ * @brief Parse contiguous input in chunks of 1-64 bytes chosen by a seed.
+ * Zero seed means the whole input at once.
+ */
+parse_result parseChunks(const std::string& input, unsigned seed) {
+    parse_result r;
+    http::request_parser parser;
+    const auto begin = input.data();
+    const auto end = begin + input.size();
+    auto it = begin;
+    r.result = http::request_parser::indeterminate;
+    while (it != end && r.result == http::request_parser::indeterminate) {
+        auto chunkEnd = end;
+        if (seed) {
+            seed = seed * 1103515245u + 12345u;
+            chunkEnd = it + std::min<size_t>(end - it, 1 + (seed >> 16) % 64);
+        }
+        std::tie(r.result, it) = parser.parse(r.view, it, chunkEnd);
+    }
+    r.consumed = it - begin;
+    return r;
+}
+
+/// Offsets of empty slices are not defined.
+bool sameSlice(http::slice a, http::slice b) {
+    return a.length == b.length && (a.length == 0 || a.offset == b.offset);
+}
+
+bool sameResult(const parse_result& a, const parse_result& b) {
+    if (a.result != b.result || a.consumed != b.consumed)
+        return false;
+    if (a.result != http::request_parser::good)
+        return true;
+    if (!sameSlice(a.view.method, b.view.method)
+            || !sameSlice(a.view.uri, b.view.uri)
+            || a.view.http_version_major != b.view.http_version_major
+            || a.view.http_version_minor != b.view.http_version_minor
+            || a.view.header_count != b.view.header_count)
+        return false;
+    for (size_t i = 0; i < a.view.header_count; ++i) {
+        if (!sameSlice(a.view.headers[i].name, b.view.headers[i].name)
+                || !sameSlice(a.view.headers[i].value
+                            , b.view.headers[i].value))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Change a few bytes of an input: replace, insert or erase them.
+ */
+void mutate(std::string& input, std::mt19937& random) {
+    static const char INTERESTING[] = "GETHAD /:\r\n \t.%?@\x7f\x80";
+    const auto count = 1 + random() % 4;
+    for (size_t i = 0; i < count && !input.empty(); ++i) {
+        const auto pos = random() % input.size();
+        const auto ch = random() % 2
+                      ? static_cast<char>(random())
+                      : INTERESTING[random() % (sizeof(INTERESTING) - 1)];
+        switch (random() % 3) {
+            case 0: input[pos] = ch; break;
+            case 1: input.insert(input.begin() + pos, ch); break;
+            default: input.erase(pos, 1); break;
+        }
+    }
+}
+
+/**
+ * @brief Compare every scanner with the reference on one input.
+ *
+ * @return false on a mismatch, which is printed.
+ */
+bool check(const std::string& input, unsigned seed) {
+    static const char* const ISA_NAMES[] = {"none", "scalar", "sse42", "avx2"};
+    const auto reference = parseReference(input);
+    for (const auto isa: {http::scanner::none, http::scanner::scalar
+                        , http::scanner::sse42, http::scanner::avx2}) {
+        if (!http::scanner::use_isa(isa))
+            continue;
+        if (sameResult(parseChunks(input, 0), reference)
+                && sameResult(parseChunks(input, seed), reference))
+            continue;
+        fprintf(stderr, "Scanner %s differs from the reference on:\n"
+              , ISA_NAMES[isa]);
+        fwrite(input.data(), 1, input.size(), stderr);
+        fputc('\n', stderr);
+        return false;
+    }
+    return true;
+}
+}
+
+int main() {
+    const auto best = http::scanner::best_isa();
+    std::mt19937 random(1);
+    size_t inputs = 0;
+    for (const auto& sample: makeSamples()) {
+        if (!check(sample, ++inputs))
+            return EXIT_FAILURE;
+        for (int i = 0; i < MUTATIONS; ++i) {
+            auto input = sample;
+            mutate(input, random);
+            if (!check(input, ++inputs))
+                return EXIT_FAILURE;
+        }
+    }
+    http::scanner::use_isa(best);
+    printf("%zu inputs, all scanners match the reference\n", inputs);
+    return EXIT_SUCCESS;
+}
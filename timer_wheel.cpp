@@ -0,0 +1,136 @@
+/*
+ * timer_wheel.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "timer_wheel.h"
+
+#include <algorithm>
+#include <climits>
+
+namespace {
+constexpr uint64_t NS_IN_MS = 1000 * 1000;
+}
+
+namespace http {
+constexpr uint64_t timer_wheel::DEFAULT_TICK;
+constexpr unsigned timer_wheel::SLOTS;
+constexpr unsigned timer_wheel::NONE;
+
+timer_wheel::timer_wheel(uint64_t tick)
+    : m_tick(std::max<uint64_t>(tick, 1))
+{
+    std::fill(std::begin(m_heads), std::end(m_heads), NONE);
+}
+
+void timer_wheel::schedule(unsigned id, uint64_t deadline) {
+    if (id >= m_nodes.size())
+        m_nodes.resize(id + 1);
+    // Timers never fire early, so the deadline is rounded up.
+    const auto tick = std::max(deadline / m_tick + (deadline % m_tick != 0)
+                             , m_current);
+    auto& n = m_nodes[id];
+    if (n.armed) {
+        if (n.tick == tick)
+            return;
+        unlink(id);
+    }
+    link(id, tick);
+}
+
+void timer_wheel::cancel(unsigned id) noexcept {
+    if (id < m_nodes.size() && m_nodes[id].armed)
+        unlink(id);
+}
+
+void timer_wheel::expire(uint64_t now, std::vector<unsigned>& expired) {
+    expired.clear();
+    const auto target = now / m_tick;
+    if (target < m_current)
+        return;
+
+    // After a long sleep every slot is visited once, a slot holds timers
+    // of all revolutions.
+    const auto steps = m_count == 0
+                     ? 0 : std::min<uint64_t>(target - m_current + 1, SLOTS);
+    for (uint64_t i = 0; i < steps; ++i) {
+        auto id = m_heads[(m_current + i) % SLOTS];
+        while (id != NONE) {
+            const auto next = m_nodes[id].next;
+            if (m_nodes[id].tick <= target) {
+                unlink(id);
+                expired.push_back(id);
+            }
+            id = next;
+        }
+    }
+    m_current = target + 1;
+}
+
+int timer_wheel::waitTimeout(uint64_t now) const noexcept {
+    const auto next = nextTick();
+    if (next == 0)
+        return -1;
+    if (next <= now)
+        return 0;
+    const auto ms = (next - now + NS_IN_MS - 1) / NS_IN_MS;
+    return static_cast<int>(std::min<uint64_t>(ms, INT_MAX));
+}
+
+uint64_t timer_wheel::nextTick() const noexcept {
+    if (m_count == 0)
+        return 0;
+
+    constexpr unsigned WORDS = SLOTS / WORD_BITS;
+    const unsigned start = m_current % SLOTS;
+    const unsigned startBit = start % WORD_BITS;
+    // The first word is looked at twice: bits from the current slot on,
+    // then bits before it after the wheel wraps around.
+    for (unsigned i = 0; i <= WORDS; ++i) {
+        const auto word = (start / WORD_BITS + i) % WORDS;
+        auto bits = m_occupied[word];
+        if (i == 0)
+            bits &= ~uint64_t(0) << startBit;
+        else if (i == WORDS)
+            bits &= startBit ? ~uint64_t(0) >> (WORD_BITS - startBit) : 0;
+        if (bits == 0)
+            continue;
+        const unsigned slot = word * WORD_BITS + __builtin_ctzll(bits);
+        const auto distance = (slot + SLOTS - start) % SLOTS;
+        return (m_current + distance) * m_tick;
+    }
+    return 0;
+}
+
+void timer_wheel::link(unsigned id, uint64_t tick) noexcept {
+    const auto slot = tick % SLOTS;
+    auto& n = m_nodes[id];
+    n.tick = tick;
+    n.armed = true;
+    n.prev = NONE;
+    n.next = m_heads[slot];
+    if (n.next != NONE)
+        m_nodes[n.next].prev = id;
+    m_heads[slot] = id;
+    m_occupied[slot / WORD_BITS] |= uint64_t(1) << (slot % WORD_BITS);
+    ++m_count;
+}
+
+void timer_wheel::unlink(unsigned id) noexcept {
+    const auto slot = m_nodes[id].tick % SLOTS;
+    auto& n = m_nodes[id];
+    if (n.prev != NONE)
+        m_nodes[n.prev].next = n.next;
+    else
+        m_heads[slot] = n.next;
+    if (n.next != NONE)
+        m_nodes[n.next].prev = n.prev;
+    if (m_heads[slot] == NONE)
+        m_occupied[slot / WORD_BITS] &= ~(uint64_t(1) << (slot % WORD_BITS));
+    n.prev = n.next = NONE;
+    n.armed = false;
+    --m_count;
+}
+} // namespace http
@@ -0,0 +1,104 @@
+/*
+ * timer_wheel.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace http {
+/**
+ * @brief Hashed timer wheel of one event loop.
+ * Timers are identified by small integers, e.g. socket descriptors, and
+ * kept in intrusive lists of wheel slots, so scheduling, rescheduling and
+ * cancelling take constant time. Deadlines are rounded up to whole ticks
+ * and deadlines further than one wheel revolution share slots with nearer
+ * ones, so a timer fires no earlier than its deadline and at most a tick
+ * later. Times are in nanoseconds of metrics::clock.
+ */
+class timer_wheel {
+    public:
+        static constexpr uint64_t DEFAULT_TICK = 100 * 1000 * 1000;
+
+        /**
+         * @brief Construct an empty wheel.
+         *
+         * @param tick - Timer resolution in nanoseconds.
+         */
+        explicit timer_wheel(uint64_t tick = DEFAULT_TICK);
+
+        timer_wheel(const timer_wheel&) = delete;
+        timer_wheel& operator=(const timer_wheel&) = delete;
+
+        /**
+         * @brief Arm a timer or move an armed one to a new deadline.
+         */
+        void schedule(unsigned id, uint64_t deadline);
+
+        /**
+         * @brief Disarm a timer. It is fine to cancel an unarmed one.
+         */
+        void cancel(unsigned id) noexcept;
+
+        /**
+         * @brief Disarm timers which deadlines passed.
+         *
+         * @param now - Current time.
+         * @param expired - Output ids of disarmed timers, it is cleared first.
+         */
+        void expire(uint64_t now, std::vector<unsigned>& expired);
+
+        /**
+         * @brief Get a timeout for epoll_wait in milliseconds.
+         *
+         * @return Time until the next tick with armed timers or -1 if there
+         * are no timers.
+         */
+        int waitTimeout(uint64_t now) const noexcept;
+
+        /**
+         * @brief Get the time of the next tick with armed timers.
+         *
+         * @return Zero if there are no timers.
+         */
+        uint64_t nextTick() const noexcept;
+
+        size_t size() const noexcept {
+            return m_count;
+        }
+
+    private:
+        static constexpr unsigned SLOTS = 1024;
+        static constexpr unsigned NONE = ~0u;
+        static constexpr unsigned WORD_BITS = 64;
+
+        struct node {
+            unsigned prev = NONE;
+            unsigned next = NONE;
+            /// Deadline in ticks.
+            uint64_t tick = 0;
+            bool armed = false;
+        };
+
+        void link(unsigned id, uint64_t tick) noexcept;
+        void unlink(unsigned id) noexcept;
+
+    private:
+        uint64_t m_tick;
+        /// First tick which is not expired yet.
+        uint64_t m_current = 0;
+        size_t m_count = 0;
+        std::vector<node> m_nodes;
+        unsigned m_heads[SLOTS];
+        /// Bit per non-empty slot to find the next armed tick quickly.
+        uint64_t m_occupied[SLOTS / WORD_BITS] = {};
+};
+} // namespace http
+
+#endif /* !TIMER_WHEEL_H */
@@ -0,0 +1,731 @@
+/*
+ * uring_loop.cpp
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "uring_loop.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+namespace {
+constexpr unsigned RING_ENTRIES = 1024;
+/// Largest registered file table, so the limit of clients per loop.
+constexpr unsigned MAX_CLIENTS = 16384;
+constexpr unsigned RECV_BUFFERS = 512;
+constexpr unsigned RECV_BUFFER_SIZE = 4096;
+constexpr uint16_t RECV_BUFFER_GROUP = 0;
+constexpr unsigned FILE_BUFFERS = 32;
+constexpr size_t FILE_BUFFER_SIZE = 65536;
+
+const uint8_t REQUIRED_OPS[] = {
+    IORING_OP_ACCEPT, IORING_OP_READ, IORING_OP_RECV, IORING_OP_SENDMSG
+  , IORING_OP_SEND, IORING_OP_READ_FIXED, IORING_OP_ASYNC_CANCEL
+  , IORING_OP_CLOSE
+};
+
+int ioUringSetup(unsigned entries, io_uring_params* params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int ioUringEnter(int ring, unsigned toSubmit, unsigned minComplete
+               , unsigned flags, const io_uring_getevents_arg* arg = nullptr) {
+    return syscall(__NR_io_uring_enter, ring, toSubmit, minComplete, flags
+                 , arg, arg ? sizeof(*arg) : 0);
+}
+
+int ioUringRegister(int ring, unsigned opcode, const void* arg
+                  , unsigned count) {
+    return syscall(__NR_io_uring_register, ring, opcode, arg, count);
+}
+
+unsigned* ringField(void* ring, unsigned offset) {
+    return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+}
+
+void* mapRing(int ring, size_t size, off_t offset) {
+    const auto result = mmap(nullptr, size, PROT_READ | PROT_WRITE
+                           , MAP_SHARED | MAP_POPULATE, ring, offset);
+    if (result == MAP_FAILED)
+        throw std::runtime_error("Can't map io_uring queues");
+    return result;
+}
+
+/**
+ * @brief Size of the registered file table.
+ * Kernel does not allow a table larger than the descriptors limit.
+ */
+unsigned clientsLimit() {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0)
+        return MAX_CLIENTS;
+    return static_cast<unsigned>(std::min<rlim_t>(limit.rlim_cur, MAX_CLIENTS));
+}
+
+uint64_t userData(uint8_t op, unsigned index) {
+    return static_cast<uint64_t>(index) << 8 | op;
+}
+}
+
+namespace http {
+uring_loop::uring_loop(int listenSocket, const request_handler& handler
+                     , metrics_shard& stats
+                     , const connection_timeouts& timeouts
+                     , const admission_limits& limits)
+    : m_listenSocket(listenSocket)
+    , m_handler(handler)
+    , m_stats(stats)
+    , m_timeouts(timeouts)
+    , m_gate(limits, stats)
+    , m_clients(clientsLimit())
+{
+    try {
+        setupRing();
+        setupResources();
+        m_wakeFd = eventfd(0, EFD_CLOEXEC);
+        if (m_wakeFd < 0)
+            throw std::runtime_error("Can't create an eventfd");
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+uring_loop::~uring_loop() {
+    release();
+}
+
+void uring_loop::release() noexcept {
+    // Closing the ring cancels pending requests and closes client sockets.
+    if (m_ring != INVALID_FD)
+        close(m_ring);
+    m_ring = INVALID_FD;
+    if (m_wakeFd != INVALID_FD)
+        close(m_wakeFd);
+    m_wakeFd = INVALID_FD;
+    if (m_bufRing)
+        munmap(m_bufRing, m_bufRingSize);
+    m_bufRing = nullptr;
+    if (m_sqes)
+        munmap(m_sqes, m_sqesSize);
+    m_sqes = nullptr;
+    if (m_cqRing && m_cqRing != m_sqRing)
+        munmap(m_cqRing, m_cqRingSize);
+    m_cqRing = nullptr;
+    if (m_sqRing)
+        munmap(m_sqRing, m_sqRingSize);
+    m_sqRing = nullptr;
+}
+
+void uring_loop::setupRing() {
+    std::memset(&m_params, 0, sizeof(m_params));
+    // The worker thread is the only submitter, so the kernel may run
+    // completion work when the thread waits instead of interrupting it.
+    // The ring is enabled by the worker thread, which becomes its owner.
+    m_params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER
+                   | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED;
+    m_params.cq_entries = RING_ENTRIES * 4;
+    m_ring = ioUringSetup(RING_ENTRIES, &m_params);
+    if (m_ring < 0 && errno == EINVAL) {
+        std::memset(&m_params, 0, sizeof(m_params));
+        m_params.flags = IORING_SETUP_CQSIZE;
+        m_params.cq_entries = RING_ENTRIES * 4;
+        m_ring = ioUringSetup(RING_ENTRIES, &m_params);
+    }
+    if (m_ring < 0)
+        throw std::runtime_error("Can't create io_uring");
+    m_enableRing = m_params.flags & IORING_SETUP_R_DISABLED;
+
+    const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP
+                            | IORING_FEAT_FAST_POLL | IORING_FEAT_EXT_ARG;
+    if ((m_params.features & required) != required)
+        throw std::runtime_error("io_uring lacks required features");
+    // Without it the flag fails linked reads, so successful reads are
+    // reported and ignored.
+    m_skipSuccess = m_params.features & IORING_FEAT_CQE_SKIP;
+
+    m_sqRingSize = m_params.sq_off.array
+                 + m_params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = m_params.cq_off.cqes
+                 + m_params.cq_entries * sizeof(io_uring_cqe);
+    m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+    m_sqRing = m_cqRing = mapRing(m_ring, m_sqRingSize, IORING_OFF_SQ_RING);
+    m_sqesSize = m_params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = static_cast<io_uring_sqe*>(
+            mapRing(m_ring, m_sqesSize, IORING_OFF_SQES));
+
+    // Submission slots are always used in order.
+    const auto array = ringField(m_sqRing, m_params.sq_off.array);
+    for (unsigned i = 0; i < m_params.sq_entries; ++i)
+        array[i] = i;
+
+    std::vector<char> probeMemory(sizeof(io_uring_probe)
+                                + 256 * sizeof(io_uring_probe_op));
+    const auto probe = reinterpret_cast<io_uring_probe*>(probeMemory.data());
+    if (ioUringRegister(m_ring, IORING_REGISTER_PROBE, probe, 256) < 0)
+        throw std::runtime_error("Can't probe io_uring operations");
+    for (const auto op: REQUIRED_OPS) {
+        if (op > probe->last_op
+                || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            throw std::runtime_error("io_uring lacks required operations");
+    }
+}
+
+void uring_loop::setupResources() {
+    io_uring_rsrc_register files;
+    std::memset(&files, 0, sizeof(files));
+    files.nr = static_cast<unsigned>(m_clients.size());
+    files.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (ioUringRegister(m_ring, IORING_REGISTER_FILES2, &files
+                      , sizeof(files)) < 0)
+        throw std::runtime_error("Can't register io_uring file table");
+
+    m_fileBuffers.resize(FILE_BUFFERS * FILE_BUFFER_SIZE);
+    iovec buffers[FILE_BUFFERS];
+    for (unsigned i = 0; i < FILE_BUFFERS; ++i) {
+        buffers[i].iov_base = &m_fileBuffers[i * FILE_BUFFER_SIZE];
+        buffers[i].iov_len = FILE_BUFFER_SIZE;
+        m_freeFileBuffers.push_back(i);
+    }
+    if (ioUringRegister(m_ring, IORING_REGISTER_BUFFERS, buffers
+                      , FILE_BUFFERS) < 0)
+        throw std::runtime_error("Can't register io_uring buffers");
+
+    // Provided buffer ring is picked by the kernel when data arrives,
+    // so idle clients do not hold receive buffers.
+    m_bufRingSize = RECV_BUFFERS * sizeof(io_uring_buf);
+    const auto ring = mmap(nullptr, m_bufRingSize, PROT_READ | PROT_WRITE
+                         , MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+        throw std::runtime_error("Can't allocate io_uring buffer ring");
+    m_bufRing = static_cast<io_uring_buf_ring*>(ring);
+
+    io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(m_bufRing);
+    reg.ring_entries = RECV_BUFFERS;
+    reg.bgid = RECV_BUFFER_GROUP;
+    if (ioUringRegister(m_ring, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        throw std::runtime_error("Can't register io_uring buffer ring");
+
+    m_recvBuffers.resize(RECV_BUFFERS * RECV_BUFFER_SIZE);
+    for (unsigned i = 0; i < RECV_BUFFERS; ++i)
+        recycleBuffer(i);
+}
+
+void uring_loop::run() {
+    metrics::attach(&m_stats);
+    if (m_enableRing
+            && ioUringRegister(m_ring, IORING_REGISTER_ENABLE_RINGS
+                             , nullptr, 0) < 0) {
+        logger::message(log_level::error, "Can't enable io_uring: %s"
+                      , strerror(errno));
+        return;
+    }
+    m_enableRing = false;
+
+    armAccept();
+    armWake();
+    while (!m_stopped) {
+        submitAndWait();
+        m_gate.batchStarted(metrics::now());
+        handleCompletions();
+        expireClients();
+        if (m_draining) {
+            if (m_gate.connections() == 0)
+                break;
+        } else if (!m_gate.canAccept()) {
+            pauseAccept();
+        } else if (m_acceptPaused && !m_accepting) {
+            m_acceptPaused = false;
+            armAccept();
+        }
+
+        // Buffers are recycled by now, so starved clients may retry.
+        std::vector<unsigned> starved;
+        starved.swap(m_starved);
+        for (const auto index: starved) {
+            if (m_clients[index])
+                progress(index);
+        }
+    }
+}
+
+void uring_loop::stop() noexcept {
+    m_stopRequested = true;
+    const uint64_t one = 1;
+    // write(2) is async-signal-safe, so it is fine to call it from a handler.
+    const auto result = write(m_wakeFd, &one, sizeof(one));
+    static_cast<void>(result);
+}
+
+void uring_loop::drain() noexcept {
+    m_drainRequested = true;
+    const uint64_t one = 1;
+    const auto result = write(m_wakeFd, &one, sizeof(one));
+    static_cast<void>(result);
+}
+
+void uring_loop::reserveSqes(unsigned count) {
+    while (true) {
+        const auto head = __atomic_load_n(
+                ringField(m_sqRing, m_params.sq_off.head), __ATOMIC_ACQUIRE);
+        if (m_params.sq_entries - (m_sqTail - head) >= count)
+            return;
+        // Queue is full, hand the prepared requests to the kernel.
+        __atomic_store_n(ringField(m_sqRing, m_params.sq_off.tail), m_sqTail
+                       , __ATOMIC_RELEASE);
+        if (ioUringEnter(m_ring, m_sqTail - head, 0, 0) < 0
+                && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            throw std::runtime_error("Can't submit io_uring requests");
+    }
+}
+
+io_uring_sqe* uring_loop::nextSqe(operation op, unsigned index) {
+    reserveSqes(1);
+    const auto mask = *ringField(m_sqRing, m_params.sq_off.ring_mask);
+    auto sqe = &m_sqes[m_sqTail & mask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = userData(static_cast<uint8_t>(op), index);
+    // The kernel sees the entry after the tail is published on submission.
+    ++m_sqTail;
+    return sqe;
+}
+
+void uring_loop::submitAndWait() {
+    const auto head = __atomic_load_n(
+            ringField(m_sqRing, m_params.sq_off.head), __ATOMIC_ACQUIRE);
+    __atomic_store_n(ringField(m_sqRing, m_params.sq_off.tail), m_sqTail
+                   , __ATOMIC_RELEASE);
+
+    // The wait is limited by the next deadline, like epoll_wait timeout.
+    io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    __kernel_timespec timeout;
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    const auto next = m_timers.nextTick();
+    if (next) {
+        const auto now = metrics::now();
+        const auto wait = next > now ? next - now : 0;
+        timeout.tv_sec = wait / 1000000000;
+        timeout.tv_nsec = wait % 1000000000;
+        arg.ts = reinterpret_cast<uint64_t>(&timeout);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+    if (ioUringEnter(m_ring, m_sqTail - head, 1, flags, next ? &arg : nullptr)
+            < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY
+            && errno != ETIME) {
+        logger::message(log_level::error, "Can't wait for io_uring: %s"
+                      , strerror(errno));
+        m_stopped = true;
+    }
+}
+
+void uring_loop::handleCompletions() {
+    const auto headPtr = ringField(m_cqRing, m_params.cq_off.head);
+    const auto tailPtr = ringField(m_cqRing, m_params.cq_off.tail);
+    const auto mask = *ringField(m_cqRing, m_params.cq_off.ring_mask);
+    const auto cqes = reinterpret_cast<io_uring_cqe*>(
+            static_cast<char*>(m_cqRing) + m_params.cq_off.cqes);
+    auto head = *headPtr;
+    const auto tail = __atomic_load_n(tailPtr, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const auto cqe = cqes[head & mask];
+        // Release the entry before handling, handlers may submit requests.
+        __atomic_store_n(headPtr, head + 1, __ATOMIC_RELEASE);
+        handleCompletion(cqe);
+    }
+}
+
+void uring_loop::handleCompletion(const io_uring_cqe& cqe) {
+    const auto op = static_cast<operation>(cqe.user_data & 0xff);
+    const auto index = static_cast<unsigned>(cqe.user_data >> 8);
+    switch (op) {
+        case operation::accept:
+            return onAccept(cqe);
+        case operation::wake:
+            return onWake();
+        case operation::recv:
+            return onRecv(index, cqe);
+        case operation::sendmsg:
+            return onSendmsg(index, cqe);
+        case operation::send:
+            return onSend(index, cqe);
+        case operation::close:
+            if (cqe.res < 0) {
+                logger::message(log_level::error, "Can't close a client: %s"
+                              , strerror(-cqe.res));
+            }
+            m_clients[index].reset();
+            if (!m_accepting && !m_acceptPaused)
+                armAccept();
+            return;
+        case operation::read:
+            // Successful reads are usually not reported. A failed or short
+            // read cancels the linked send, which handles the error.
+        case operation::cancel:
+            return;
+    }
+}
+
+void uring_loop::armAccept() {
+    if (m_draining)
+        return;
+    auto sqe = nextSqe(operation::accept, 0);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_listenSocket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    // Registered files are never inherited, so there is no SOCK_CLOEXEC.
+    sqe->file_index = IORING_FILE_INDEX_ALLOC;
+    m_accepting = true;
+}
+
+void uring_loop::pauseAccept() {
+    if (m_acceptPaused)
+        return;
+    m_acceptPaused = true;
+    m_stats.acceptPauses.add();
+    logger::message(log_level::debug, "Accepting is paused");
+    if (!m_accepting)
+        return;
+    // Clients accepted before the cancel completes are served anyway.
+    auto sqe = nextSqe(operation::cancel, 0);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = userData(static_cast<uint8_t>(operation::accept), 0);
+}
+
+void uring_loop::armWake() {
+    auto sqe = nextSqe(operation::wake, 0);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_wakeFd;
+    sqe->addr = reinterpret_cast<uint64_t>(&m_wakeValue);
+    sqe->len = sizeof(m_wakeValue);
+}
+
+void uring_loop::onWake() {
+    if (m_stopRequested) {
+        m_stopped = true;
+        return;
+    }
+    if (m_drainRequested && !m_draining)
+        startDrain();
+    armWake();
+}
+
+void uring_loop::startDrain() {
+    logger::message(log_level::info, "Draining %zu connections"
+                  , m_gate.connections());
+    m_draining = true;
+    if (m_accepting) {
+        // Clients in the backlog are left to another process sharing the
+        // socket.
+        auto sqe = nextSqe(operation::cancel, 0);
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = userData(static_cast<uint8_t>(operation::accept), 0);
+    }
+    for (unsigned index = 0; index < m_clients.size(); ++index) {
+        if (!m_clients[index] || m_clients[index]->closing)
+            continue;
+        m_clients[index]->conn->drain();
+        progress(index);
+    }
+}
+
+void uring_loop::onAccept(const io_uring_cqe& cqe) {
+    if (!(cqe.flags & IORING_CQE_F_MORE))
+        m_accepting = false;
+    if (cqe.res == -ECANCELED)
+        return;
+    if (cqe.res < 0) {
+        logger::message(log_level::error, "Can't accept a connection: %s"
+                      , strerror(-cqe.res));
+        // With the file table full accepting resumes when a client closes.
+        if (!m_accepting && !m_acceptPaused && cqe.res == -ECONNABORTED)
+            armAccept();
+        return;
+    }
+
+    const auto index = static_cast<unsigned>(cqe.res);
+    m_stats.accepts.add();
+    logger::message(log_level::debug, "Connected client %u", index);
+    // Multishot accept does not report peer addresses.
+    std::unique_ptr<connection> conn(
+            new connection(connection::INVALID_FD, 0, m_handler, m_stats
+                         , m_buffers, m_gate));
+    m_clients[index].reset(new client(std::move(conn)));
+    // Accepted before the cancel completed, so the client is served once.
+    if (m_draining)
+        m_clients[index]->conn->drain();
+    if (!m_gate.canAccept() && !m_draining)
+        pauseAccept();
+    else if (!m_accepting && !m_acceptPaused)
+        armAccept();
+    progress(index);
+}
+
+void uring_loop::onRecv(unsigned index, const io_uring_cqe& cqe) {
+    auto& c = *m_clients[index];
+    c.receiving = false;
+    if (cqe.res == -ENOBUFS) {
+        m_starved.push_back(index);
+        return;
+    }
+
+    if (cqe.res > 0) {
+        const auto id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        c.conn->receive(&m_recvBuffers[id * RECV_BUFFER_SIZE], cqe.res);
+        recycleBuffer(id);
+    } else if (cqe.res == 0 || cqe.res == -ECANCELED) {
+        c.conn->receive(nullptr, 0);
+    } else {
+        logger::message(log_level::error, "Can't read request from client: %s"
+                      , strerror(-cqe.res));
+        c.conn->abort();
+    }
+    progress(index);
+}
+
+void uring_loop::onSendmsg(unsigned index, const io_uring_cqe& cqe) {
+    auto& c = *m_clients[index];
+    c.sending = false;
+    if (cqe.res < 0) {
+        logger::message(log_level::debug, "Can't send reply: %s"
+                      , strerror(-cqe.res));
+        c.conn->abort();
+    } else {
+        c.conn->advanceOutput(cqe.res);
+    }
+    progress(index);
+}
+
+void uring_loop::onSend(unsigned index, const io_uring_cqe& cqe) {
+    auto& c = *m_clients[index];
+    if (cqe.res < 0) {
+        // Canceled send means the linked read failed or the file was
+        // truncated.
+        logger::message(log_level::debug, "Can't send file: %s"
+                      , strerror(-cqe.res));
+        c.conn->abort();
+    } else {
+        c.chunkSent += cqe.res;
+        c.conn->advanceOutput(cqe.res);
+        if (c.chunkSent < c.chunkSize && cqe.res > 0 && !c.conn->closed()) {
+            auto sqe = nextSqe(operation::send, index);
+            sqe->opcode = IORING_OP_SEND;
+            sqe->fd = index;
+            sqe->flags = IOSQE_FIXED_FILE;
+            sqe->addr = reinterpret_cast<uint64_t>(
+                    &m_fileBuffers[c.fileBuffer * FILE_BUFFER_SIZE]
+                    + c.chunkSent);
+            sqe->len = c.chunkSize - c.chunkSent;
+            sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+            return;
+        }
+        if (cqe.res == 0)
+            c.conn->abort();
+    }
+
+    c.sending = false;
+    releaseFileBuffer(c);
+    progress(index);
+}
+
+void uring_loop::progress(unsigned index) {
+    auto& c = *m_clients[index];
+    if (!c.conn->closed()) {
+        if (!c.receiving)
+            receive(index);
+        if (!c.sending)
+            send(index);
+    }
+    if (!c.conn->closed()) {
+        const auto deadline = c.conn->deadline(m_timeouts);
+        if (deadline)
+            m_timers.schedule(index, deadline);
+        else
+            m_timers.cancel(index);
+        return;
+    }
+
+    if (c.receiving && !c.cancelled) {
+        c.cancelled = true;
+        auto sqe = nextSqe(operation::cancel, index);
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = userData(static_cast<uint8_t>(operation::recv), index);
+    }
+    if (!c.receiving && !c.sending && !c.closing)
+        closeClient(index);
+}
+
+void uring_loop::receive(unsigned index) {
+    auto& c = *m_clients[index];
+    const auto space = c.conn->prepareInput();
+    if (space == 0)
+        return;
+    auto sqe = nextSqe(operation::recv, index);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = index;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUFFER_GROUP;
+    sqe->len = std::min<size_t>(space, RECV_BUFFER_SIZE);
+    c.receiving = true;
+}
+
+void uring_loop::send(unsigned index) {
+    auto& c = *m_clients[index];
+    if (!c.conn->hasOutput())
+        return;
+
+    bool hasFile = false;
+    const auto count = c.conn->gatherOutput(c.iov, connection::MAX_IOV
+                                          , hasFile);
+    if (count == 0) {
+        if (hasFile)
+            sendChunk(index);
+        return;
+    }
+
+    std::memset(&c.message, 0, sizeof(c.message));
+    c.message.msg_iov = c.iov;
+    c.message.msg_iovlen = count;
+    auto sqe = nextSqe(operation::sendmsg, index);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = index;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = reinterpret_cast<uint64_t>(&c.message);
+    sqe->len = 1;
+    // MSG_MORE lets the kernel coalesce the head with the file body.
+    sqe->msg_flags = MSG_NOSIGNAL | (hasFile ? MSG_MORE : 0);
+    c.sending = true;
+}
+
+void uring_loop::sendChunk(unsigned index) {
+    auto& c = *m_clients[index];
+    c.sending = true;
+    if (c.fileBuffer == NO_BUFFER) {
+        if (m_freeFileBuffers.empty()) {
+            c.waitingBuffer = true;
+            m_fileWaiters.push_back(index);
+            return;
+        }
+        c.fileBuffer = m_freeFileBuffers.back();
+        m_freeFileBuffers.pop_back();
+    }
+
+    const auto& reply = c.conn->frontReply();
+    const auto left = static_cast<size_t>(reply.fileEnd - reply.fileOffset);
+    c.chunkSize = std::min(left, FILE_BUFFER_SIZE);
+    c.chunkSent = 0;
+    const auto buffer = &m_fileBuffers[c.fileBuffer * FILE_BUFFER_SIZE];
+
+    // Both entries must be submitted together to stay linked.
+    reserveSqes(2);
+    auto read = nextSqe(operation::read, index);
+    read->opcode = IORING_OP_READ_FIXED;
+    read->fd = reply.file;
+    read->flags = IOSQE_IO_LINK
+                | (m_skipSuccess ? IOSQE_CQE_SKIP_SUCCESS : 0);
+    read->addr = reinterpret_cast<uint64_t>(buffer);
+    read->len = c.chunkSize;
+    read->off = reply.fileOffset;
+    read->buf_index = c.fileBuffer;
+
+    auto send = nextSqe(operation::send, index);
+    send->opcode = IORING_OP_SEND;
+    send->fd = index;
+    send->flags = IOSQE_FIXED_FILE;
+    send->addr = reinterpret_cast<uint64_t>(buffer);
+    send->len = c.chunkSize;
+    send->msg_flags = MSG_NOSIGNAL | MSG_WAITALL
+                    | (c.chunkSize < left ? MSG_MORE : 0);
+}
+
+void uring_loop::closeClient(unsigned index) {
+    auto& c = *m_clients[index];
+    c.closing = true;
+    m_timers.cancel(index);
+    auto sqe = nextSqe(operation::close, index);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = index + 1;
+}
+
+void uring_loop::expireClients() {
+    m_timers.expire(metrics::now(), m_expired);
+    for (const auto index: m_expired) {
+        if (m_clients[index] && !m_clients[index]->closing)
+            expireClient(index);
+    }
+}
+
+void uring_loop::expireClient(unsigned index) {
+    auto& c = *m_clients[index];
+    if (!c.conn->closed()) {
+        m_stats.timeouts.add();
+        logger::message(log_level::debug, "Client %u timed out", index);
+        c.conn->abort();
+    }
+
+    if (c.waitingBuffer) {
+        m_fileWaiters.erase(std::find(m_fileWaiters.begin()
+                                    , m_fileWaiters.end(), index));
+        c.waitingBuffer = false;
+        c.sending = false;
+    } else if (c.sending) {
+        // A send blocked by a client which does not read never completes
+        // by itself.
+        for (const auto op: {operation::sendmsg, operation::send}) {
+            auto sqe = nextSqe(operation::cancel, index);
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = userData(static_cast<uint8_t>(op), index);
+        }
+    }
+    // Requests are cancelled again if the client is still open on the
+    // next tick, e.g. a linked send was not issued yet.
+    c.cancelled = false;
+    progress(index);
+    if (!c.closing)
+        m_timers.schedule(index, metrics::now());
+}
+
+void uring_loop::recycleBuffer(unsigned id) {
+    const auto tail = m_bufRing->tail;
+    // Entries are addressed from the ring start: in C++ the bufs flexible
+    // array member of the kernel header is placed after an empty struct.
+    auto& buffer = reinterpret_cast<io_uring_buf*>(m_bufRing)[
+            tail & (RECV_BUFFERS - 1)];
+    buffer.addr = reinterpret_cast<uint64_t>(
+            &m_recvBuffers[id * RECV_BUFFER_SIZE]);
+    buffer.len = RECV_BUFFER_SIZE;
+    buffer.bid = id;
+    __atomic_store_n(&m_bufRing->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+void uring_loop::releaseFileBuffer(client& c) {
+    if (c.fileBuffer == NO_BUFFER)
+        return;
+    m_freeFileBuffers.push_back(c.fileBuffer);
+    c.fileBuffer = NO_BUFFER;
+
+    while (!m_fileWaiters.empty() && !m_freeFileBuffers.empty()) {
+        const auto index = m_fileWaiters.front();
+        m_fileWaiters.pop_front();
+        auto& waiter = *m_clients[index];
+        waiter.waitingBuffer = false;
+        waiter.sending = false;
+        progress(index);
+    }
+}
+} // namespace http
@@ -0,0 +1,183 @@
+/*
+ * uring_loop.h
+ * Copyright (C) 2017 Korepanov Vyacheslav <real93@live.ru>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef URING_LOOP_H
+#define URING_LOOP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <linux/io_uring.h>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+#include "admission.h"
+#include "connection.h"
+#include "io_loop.h"
+#include "metrics.h"
+#include "request_handler.h"
+#include "timer_wheel.h"
+
+namespace http {
+/**
+ * @brief Completion based I/O engine on io_uring.
+ * Clients are accepted with one multishot accept straight into the ring
+ * file table, so client sockets are registered files and have no regular
+ * descriptors. Requests are received into a ring of provided buffers,
+ * replies are sent with sendmsg and file bodies are read into registered
+ * buffers with a read linked to a send. All requests prepared during one
+ * iteration are submitted with the same io_uring_enter call which also
+ * waits for completions.
+ */
+class uring_loop: public io_loop {
+    public:
+        /**
+         * @brief Construct a loop.
+         * It throws if the kernel does not support all required features,
+         * so the caller may fall back to event_loop.
+         *
+         * @param listenSocket - Listening socket. Loop does not close it.
+         * @param handler - Request handler. It must outlive the loop.
+         * @param stats - Metrics shard owned by the loop thread.
+         * It must outlive the loop.
+         * @param timeouts - Deadlines of client connections.
+         * @param limits - Overload limits of the loop.
+         */
+        uring_loop(int listenSocket, const request_handler& handler
+                 , metrics_shard& stats
+                 , const connection_timeouts& timeouts
+                 , const admission_limits& limits) noexcept(false);
+        ~uring_loop() override;
+
+        uring_loop(const uring_loop&) = delete;
+        uring_loop& operator=(const uring_loop&) = delete;
+
+        void run() override;
+        void stop() noexcept override;
+        void drain() noexcept override;
+
+    private:
+        enum class operation: uint8_t {
+            accept,
+            wake,
+            recv,
+            sendmsg,
+            read,
+            send,
+            cancel,
+            close
+        };
+
+        struct client {
+            explicit client(std::unique_ptr<connection>&& c)
+                : conn(std::move(c))
+            {}
+
+            std::unique_ptr<connection> conn;
+            bool receiving = false;
+            /// Reply data is being sent or waits for a file buffer.
+            bool sending = false;
+            bool waitingBuffer = false;
+            /// Pending recv is cancelled, because the client is done.
+            bool cancelled = false;
+            bool closing = false;
+            /// Registered buffer with a file chunk or NO_BUFFER.
+            int fileBuffer = NO_BUFFER;
+            size_t chunkSize = 0;
+            size_t chunkSent = 0;
+            msghdr message;
+            iovec iov[connection::MAX_IOV];
+        };
+
+        static constexpr int NO_BUFFER = -1;
+
+        void setupRing();
+        void release() noexcept;
+        void setupResources();
+        void reserveSqes(unsigned count);
+        io_uring_sqe* nextSqe(operation op, unsigned index);
+        void submitAndWait();
+        void handleCompletions();
+        void handleCompletion(const io_uring_cqe& cqe);
+        void armAccept();
+        void pauseAccept();
+        void armWake();
+        void onWake();
+        void startDrain();
+        void onAccept(const io_uring_cqe& cqe);
+        void onRecv(unsigned index, const io_uring_cqe& cqe);
+        void onSendmsg(unsigned index, const io_uring_cqe& cqe);
+        void onSend(unsigned index, const io_uring_cqe& cqe);
+        void progress(unsigned index);
+        void receive(unsigned index);
+        void send(unsigned index);
+        void sendChunk(unsigned index);
+        void closeClient(unsigned index);
+        void expireClients();
+        void expireClient(unsigned index);
+        void recycleBuffer(unsigned id);
+        void releaseFileBuffer(client& c);
+
+    private:
+        static constexpr int INVALID_FD = -1;
+        int m_ring = INVALID_FD;
+        int m_wakeFd = INVALID_FD;
+        int m_listenSocket;
+        const request_handler& m_handler;
+        metrics_shard& m_stats;
+        const connection_timeouts m_timeouts;
+        bool m_stopped = false;
+        /// Requests of other threads, they come with a wake-up.
+        std::atomic<bool> m_stopRequested{false};
+        std::atomic<bool> m_drainRequested{false};
+        /// Accept is not armed, the loop ends with the last client.
+        bool m_draining = false;
+        bool m_enableRing = false;
+        /// Kernel supports IOSQE_CQE_SKIP_SUCCESS.
+        bool m_skipSuccess = false;
+        /// Multishot accept is armed.
+        bool m_accepting = false;
+        /// Accept is cancelled until limits allow more clients.
+        bool m_acceptPaused = false;
+        uint64_t m_wakeValue = 0;
+
+        io_uring_params m_params;
+        void* m_sqRing = nullptr;
+        size_t m_sqRingSize = 0;
+        void* m_cqRing = nullptr;
+        size_t m_cqRingSize = 0;
+        io_uring_sqe* m_sqes = nullptr;
+        size_t m_sqesSize = 0;
+        unsigned m_sqTail = 0;
+
+        /// Ring of provided buffers for received data.
+        io_uring_buf_ring* m_bufRing = nullptr;
+        size_t m_bufRingSize = 0;
+        std::vector<char> m_recvBuffers;
+        /// Registered buffers for file chunks.
+        std::vector<char> m_fileBuffers;
+        std::vector<int> m_freeFileBuffers;
+        /// Clients waiting for a free file buffer.
+        std::deque<unsigned> m_fileWaiters;
+        /// Clients which recv failed because no provided buffer was free.
+        std::vector<unsigned> m_starved;
+
+        admission m_gate;
+        /// Receive buffers and reply heads of all connections.
+        buffer_pool m_buffers;
+        /// Clients indexed by their registered file index.
+        std::vector<std::unique_ptr<client>> m_clients;
+        /// Deadlines of clients indexed by their registered file index.
+        timer_wheel m_timers;
+        std::vector<unsigned> m_expired;
+};
+} // namespace http
+
+#endif /* !URING_LOOP_H */